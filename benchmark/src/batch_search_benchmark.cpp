@@ -0,0 +1,50 @@
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include "regex_expression.h"
+#include "regex_interpreter.h"
+
+static PoorInterpreter::Ptr compile(const std::string &re) {
+    ExpressionArena arena;
+    ExpressionArena::Scope scope(arena);
+    auto regex = parseRegex(re);
+    Range<unsigned char>::List unifiedRanges;
+    regex->setNormalize(&unifiedRanges);
+    regex->setUnify(unifiedRanges);
+    regex = factorize(regex);
+    auto nfa = regex->generateEpsilonNfa();
+    std::map<State::List, State::Ptr> nfaStateMap;
+    auto dfa = powerset(nfa, poorEpsilonChecker, nfaStateMap);
+    std::map<State::Ptr, State::Ptr> dfaStateMap;
+    return PoorInterpreter::Ptr(new PoorInterpreter(Hopcroft(dfa, dfaStateMap)));
+}
+
+int main(int argc, char *argv[])
+{
+    size_t count = argc > 1 ? std::stoul(argv[1]) : 1 << 20;
+    auto interpreter = compile("https?://[a-z0-9.\\-]+(:[0-9]+)?(/[a-zA-Z0-9_.\\-]*)*(\\?[a-z]+=[a-z0-9]+(&[a-z]+=[a-z0-9]+)*)?");
+    std::vector<std::string> urls;
+    for (size_t i = 0; i < count; ++i)
+        urls.emplace_back("https://host" + std::to_string(i % 977) + ".example.com:8080/path/to/item_" + std::to_string(i) + "?id=" + std::to_string(i * 7));
+    std::vector<const char *> inputs;
+    for (auto &url : urls)
+        inputs.emplace_back(url.c_str());
+    std::vector<PoorInterpreter::Result> results(count);
+
+    std::cout << "searchHead over " << count << " URLs" << std::endl;
+    std::cout << "Mode\t\tSeconds" << std::endl;
+    auto begin = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < count; ++i)
+        interpreter->searchHead(inputs[i], &results[i]);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+    std::cout << "serial\t\t" << std::fixed << std::setprecision(3) << elapsed.count() << std::endl;
+    for (int prefetch = 0; prefetch < 2; ++prefetch) {
+        begin = std::chrono::steady_clock::now();
+        interpreter->searchHeadBatch(inputs.data(), count, results.data(), prefetch);
+        elapsed = std::chrono::steady_clock::now() - begin;
+        std::cout << (prefetch ? "batch+prefetch\t" : "batch\t\t") << elapsed.count() << std::endl;
+    }
+    return 0;
+}
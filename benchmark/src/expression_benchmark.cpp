@@ -0,0 +1,55 @@
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include "regex_expression.h"
+#include "regex_algorithm.h"
+
+// alternatives in the shape of a keyword table: k0[a-z_]*(x|y)?|k1[a-z_]*(x|y)?|...
+static std::string generate(size_t size) {
+    std::string pattern;
+    for (int i = 0; pattern.size() < size; ++i)
+        pattern += (i ? "|" : "") + std::string("k") + std::to_string(i) + "[a-z_]*(x|y)?";
+    return pattern;
+}
+
+template <typename Function>
+static double measure(int rounds, Function function) {
+    auto begin = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; ++i)
+        function();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+    return elapsed.count() * 1000 / rounds;
+}
+
+int main(int argc, char *argv[])
+{
+    int rounds = argc > 1 ? std::stoi(argv[1]) : 20;
+    std::cout << "milliseconds per pass over generated patterns" << std::endl;
+    std::cout << "Size\tNodes KiB\tParse\tEquals\tDot\tSets\tSimplify\tNFA" << std::endl;
+    for (size_t size : {1000, 10000, 100000}) {
+        std::string pattern = generate(size);
+        ExpressionArena arena;
+        ExpressionArena::Scope scope(arena);
+        Expression::Ptr regex = nullptr, other = parseRegex(pattern);
+        size_t before = arena.bytes();
+        double parse = measure(rounds, [&]() { regex = parseRegex(pattern); });
+        size_t nodes = (arena.bytes() - before) / rounds;
+        double equals = measure(rounds, [&]() { regex->equals(other); });
+        double dot = measure(rounds, [&]() {
+            std::ostringstream os;
+            regex->graphviz(os);
+        });
+        double sets = measure(rounds, [&]() {
+            Range<unsigned char>::List unifiedRanges;
+            regex->setNormalize(&unifiedRanges);
+            regex->setUnify(unifiedRanges);
+        });
+        double simplification = measure(rounds, [&]() { simplify(parseRegex(pattern)); }) - parse;
+        double nfa = measure(rounds, [&]() { regex->generateEpsilonNfa(); });
+        std::cout << size << "\t" << (nodes >> 10) << "\t\t" << std::fixed << std::setprecision(3)
+                  << parse << "\t" << equals << "\t" << dot << "\t" << sets << "\t" << simplification << "\t\t" << nfa << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,64 @@
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include "regex_compiler.h"
+#include "regex_jit.h"
+
+// the C lexer patterns of the interpreter unittests (K&R2: A.2)
+static const std::string integerSuffixOpt = "(([uU]ll)|([uU]LL)|(ll[uU]?)|(LL[uU]?)|([uU][lL])|([lL][uU]?)|[uU])?";
+static const std::string escapeSequence = "(\\\\(([a-zA-Z._~!=&\\^\\-\\\\?'\"])|([0-9]+)|(x[0-9a-fA-F]+)))";
+static const std::string exponentPart = "([eE][-+]?[0-9]+)";
+static const std::string fractionalConstant = "([0-9]*\\.[0-9]+)|([0-9]+\\.)";
+static const std::vector<std::pair<std::string, std::string>> corpus = {
+    {"identifier", "[a-zA-Z_$][0-9a-zA-Z_$]*"},
+    {"decimalConstant", "(0" + integerSuffixOpt + ")|([1-9][0-9]*" + integerSuffixOpt + ")"},
+    {"hexConstant", "0[xX][0-9a-fA-F]+" + integerSuffixOpt},
+    {"floatingConstant", "((((" + fractionalConstant + ")" + exponentPart + "?)|([0-9]+" + exponentPart + "))[FfLl]?)"},
+    {"charConst", "'([^'\\\\\\n]|" + escapeSequence + ")'"},
+    {"stringLiteral", "\"([^\"\\\\\\n]|" + escapeSequence + ")*\""},
+    {"comment", "/\\*([^*]|\\*+[^*/])*\\*+/"},
+};
+
+int main(int argc, char *argv[])
+{
+    size_t size = (argc > 1 ? std::stoul(argv[1]) : 16) << 20;
+    const std::string lines[] = {
+        "static int counter_42 = 0x1fUL + 017;\n",
+        "    printf(\"value: %d\\n, name: %s with a longer tail of text\", x, name);\n",
+        "/* a block comment that runs for a while, * with stars * inside it */\n",
+        "double ratio = 3.25e-4 * width / .5f;\n",
+        "if (c == '\\n' || c == '\\t') return;\n",
+    };
+    // one search per line, so both engines run the same restart-per-offset loop
+    std::vector<std::string> text;
+    for (size_t i = 0, total = 0; total < size; ++i) {
+        text.emplace_back(lines[i % 5]);
+        total += text.back().size();
+    }
+
+    std::cout << "search over " << (size >> 20) << " MiB of C source, one line at a time" << std::endl;
+    std::cout << "Pattern\t\t\tMatches\tTable\tJIT\tSpeedup" << std::endl;
+    for (auto &entry : corpus) {
+        auto table = compile(entry.second);
+        JitInterpreter jit(table);
+        if (!jit.isCompiled())
+            std::cout << "(JIT unavailable, timing the fallback)" << std::endl;
+        PoorInterpreter::Result result;
+        size_t matches = 0, jitMatches = 0;
+        auto begin = std::chrono::steady_clock::now();
+        for (auto &line : text)
+            matches += table->search(line.c_str(), &result);
+        std::chrono::duration<double> tableElapsed = std::chrono::steady_clock::now() - begin;
+        begin = std::chrono::steady_clock::now();
+        for (auto &line : text)
+            jitMatches += jit.search(line.c_str(), &result);
+        std::chrono::duration<double> jitElapsed = std::chrono::steady_clock::now() - begin;
+        if (jitMatches != matches)
+            std::cout << "mismatch: " << jitMatches << " JIT matches" << std::endl;
+        std::cout << std::left << std::setw(24) << entry.first << matches << "\t" << std::fixed << std::setprecision(3)
+                  << tableElapsed.count() << "\t" << jitElapsed.count() << "\t" << tableElapsed.count() / jitElapsed.count() << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,61 @@
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include "regex_compiler.h"
+
+// the C lexer patterns of the interpreter unittests (K&R2: A.2)
+static const std::string integerSuffixOpt = "(([uU]ll)|([uU]LL)|(ll[uU]?)|(LL[uU]?)|([uU][lL])|([lL][uU]?)|[uU])?";
+static const std::string escapeSequence = "(\\\\(([a-zA-Z._~!=&\\^\\-\\\\?'\"])|([0-9]+)|(x[0-9a-fA-F]+)))";
+static const std::string exponentPart = "([eE][-+]?[0-9]+)";
+static const std::string fractionalConstant = "([0-9]*\\.[0-9]+)|([0-9]+\\.)";
+static const std::string hexDigits = "[0-9a-fA-F]+";
+
+// (a|b)*a(a|b)^n: the subset construction needs 2^(n+1) states
+static std::string blowup(int n) {
+    std::string pattern = "(a|b)*a";
+    for (int i = 0; i < n; ++i)
+        pattern += "(a|b)";
+    return pattern;
+}
+
+int main()
+{
+    std::vector<std::pair<std::string, std::string>> corpus = {
+        {"identifier", "[a-zA-Z_$][0-9a-zA-Z_$]*"},
+        {"decimalConstant", "(0" + integerSuffixOpt + ")|([1-9][0-9]*" + integerSuffixOpt + ")"},
+        {"hexConstant", "0[xX]" + hexDigits + integerSuffixOpt},
+        {"floatingConstant", "((((" + fractionalConstant + ")" + exponentPart + "?)|([0-9]+" + exponentPart + "))[FfLl]?)"},
+        {"hexFloatingConstant", "(0[xX](" + hexDigits + "|(((" + hexDigits + ")?\\." + hexDigits + ")|(" + hexDigits + "\\.)))([pP][+-]?[0-9]+)[FfLl]?)"},
+        {"stringLiteral", "\"([^\"\\\\\\n]|" + escapeSequence + ")*\""},
+    };
+    // the minimal DFA stays exponential here, so both strategies must pay it
+    for (int n : {6, 8, 10})
+        corpus.emplace_back("blowup" + std::to_string(n), blowup(n));
+    // here the forward DFA is exponential but the minimal one has one state
+    for (int n : {6, 8, 10})
+        corpus.emplace_back("blowupOrAll" + std::to_string(n), "(a|b)*|" + blowup(n));
+
+    const std::pair<const char *, Minimization> strategies[] = {
+        {"Hopcroft", Minimization::Hopcroft},
+        {"Brzozowski", Minimization::Brzozowski},
+        {"Automatic", Minimization::Automatic},
+    };
+    std::cout << "Pattern\t\t\tStates\tHopcroft\tBrzozowski\tAutomatic" << std::endl;
+    for (auto &entry : corpus) {
+        std::cout << std::left << std::setw(24) << entry.first;
+        for (auto &strategy : strategies) {
+            CompileOptions options;
+            options.minimization = strategy.second;
+            auto begin = std::chrono::steady_clock::now();
+            PoorInterpreter interpreter(compileDfa(entry.second, options));
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+            if (strategy.second == Minimization::Hopcroft)
+                std::cout << interpreter.getStateCount() << "\t";
+            std::cout << std::fixed << std::setprecision(4) << elapsed.count() << "\t\t";
+        }
+        std::cout << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,48 @@
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <thread>
+#include "regex_expression.h"
+#include "regex_interpreter.h"
+
+static PoorInterpreter::Ptr compile(const std::string &re) {
+    ExpressionArena arena;
+    ExpressionArena::Scope scope(arena);
+    auto regex = parseRegex(re);
+    Range<unsigned char>::List unifiedRanges;
+    regex->setNormalize(&unifiedRanges);
+    regex->setUnify(unifiedRanges);
+    regex = factorize(regex);
+    auto nfa = regex->generateEpsilonNfa();
+    std::map<State::List, State::Ptr> nfaStateMap;
+    auto dfa = powerset(nfa, poorEpsilonChecker, nfaStateMap);
+    std::map<State::Ptr, State::Ptr> dfaStateMap;
+    return PoorInterpreter::Ptr(new PoorInterpreter(Hopcroft(dfa, dfaStateMap)));
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned maxThreads = argc > 1 ? std::stoul(argv[1]) : std::max(4u, std::thread::hardware_concurrency());
+    size_t size = argc > 2 ? std::stoul(argv[2]) : 64 << 20;
+    const char *line = "static int counter_42 = 0x1f; /* \"quoted\" */ while (counter_42--) total += value[i];\n";
+    std::string input;
+    input.reserve(size);
+    while (input.size() < size)
+        input += line;
+
+    auto interpreter = compile("[a-zA-Z_$][0-9a-zA-Z_$]*");
+    auto ignore = [](const PoorInterpreter::Result &) {};
+    double serial = 0;
+    std::cout << "parallelSearchAll over " << (input.size() >> 20) << " MiB" << std::endl;
+    std::cout << "Threads\tMatches\tSeconds\tSpeedup" << std::endl;
+    for (unsigned threads = 1; threads <= maxThreads; ++threads) {
+        auto begin = std::chrono::steady_clock::now();
+        size_t count = interpreter->parallelSearchAll(input.c_str(), threads, ignore);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+        if (threads == 1)
+            serial = elapsed.count();
+        std::cout << threads << "\t" << count << "\t" << std::fixed << std::setprecision(3) << elapsed.count() << "\t" << serial / elapsed.count() << std::endl;
+    }
+    return 0;
+}
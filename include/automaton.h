@@ -23,7 +23,8 @@ struct Transition {
         Epsilon,
         BeginString,
         EndString,
-        Nop
+        Nop,
+        Tag
     };
     
     using Ptr = std::shared_ptr<Transition>;
@@ -35,6 +36,8 @@ struct Transition {
     std::shared_ptr<State> target;
     Range<unsigned char> range;
     Type type;
+    // which register a Tag transition writes the position into
+    int32_t tag;
 };
 
 struct State {
@@ -52,8 +55,10 @@ public:
     typename Transition::List transitions;
     typename State::List states;
     typename State::Ptr startState;
+    // where matching starts at the beginning of the text, if not startState
+    typename State::Ptr beginState;
     typedef std::shared_ptr<Automaton> Ptr;
-    Automaton() : startState(nullptr) {}
+    Automaton() : startState(nullptr), beginState(nullptr) {}
     State::Ptr getState();
     Transition::Ptr getTransition(State::Ptr from, State::Ptr to);
     Transition::Ptr getChars(State::Ptr from, State::Ptr to, Range<unsigned char> range);
@@ -61,18 +66,20 @@ public:
     Transition::Ptr getBeginString(State::Ptr from, State::Ptr to);
     Transition::Ptr getEndString(State::Ptr from, State::Ptr to);
     Transition::Ptr getNop(State::Ptr from, State::Ptr to);
+    Transition::Ptr getTag(State::Ptr from, State::Ptr to, int32_t tag);
     std::ostream & toMermaid(std::ostream &);
     void reverse();
     void reachableTrim();
+    bool hasAnchors() const;
 };
 
 extern bool poorEpsilonChecker(Transition::Ptr);
 extern bool richEpsilonChecker(Transition::Ptr);
+extern bool poorBeginChecker(Transition::Ptr);
 extern bool epsilonClosure(typename State::Ptr nfaState, bool (*epsilonChecker)(Transition::Ptr), State::Set &epsilonStates, Transition::Map<State::Set> &transitions);
-extern Automaton::Ptr powerset(Automaton::Ptr nfa, bool (*epsilonChecker)(Transition::Ptr), std::map<State::List, State::Ptr> &);
-extern std::vector<State::Set> split(State::Set states, const std::set<State::Set> &partition);
+extern Automaton::Ptr powerset(Automaton::Ptr nfa, bool (*epsilonChecker)(Transition::Ptr), std::map<State::List, State::Ptr> &, size_t stateLimit=0, bool (*beginChecker)(Transition::Ptr)=nullptr, bool leftmostFirst=false);
 extern Automaton::Ptr Hopcroft(Automaton::Ptr dfa, std::map<State::Ptr, State::Ptr> &);
-// extern Automaton::Ptr Brzozowski(Automaton::Ptr nfa, bool (*epsilonChecker)(Transition::Ptr));
+extern Automaton::Ptr Brzozowski(Automaton::Ptr nfa, bool (*epsilonChecker)(Transition::Ptr));
 
 struct EpsilonNfa {
     State::Ptr start;
@@ -0,0 +1,41 @@
+#ifndef DICTIONARY_H
+#define DICTIONARY_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include "automaton.h"
+
+/**
+ *  Builds the minimal acyclic DFA of a word list incrementally
+ *  (Daciuk, Mihov, Watson & Watson, 2000). Words must be inserted in
+ *  lexicographic order; each finished branch is merged with an equivalent
+ *  registered state right away, so only the minimal automaton plus the
+ *  path of the last word are ever kept in memory. Words may still be
+ *  inserted after build().
+**/
+class DictionaryBuilder {
+    using Edges = std::vector<std::pair<unsigned char, int32_t>>;
+    struct Node {
+        Edges edges;
+        bool isAccepted;
+        int32_t parents;    // edges leading here
+    };
+    using Signature = std::pair<bool, Edges>;
+    std::vector<Node> nodes;
+    std::vector<int32_t> freeNodes;
+    std::map<Signature, int32_t> registry;
+    std::vector<int32_t> path;
+    std::string previous;
+    int32_t getNode();
+    void replaceOrRegister(size_t depth);
+    void unregisterPath(size_t depth);
+public:
+    DictionaryBuilder();
+    void insert(const std::string &word);
+    Automaton::Ptr build();
+    size_t size() const;
+};
+
+extern Automaton::Ptr buildDictionary(std::vector<std::string> words);
+#endif
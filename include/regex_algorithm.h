@@ -1,170 +1,332 @@
 #ifndef REGEX_ALGORITHM_H
 #define REGEX_ALGORITHM_H
 
+#include <unordered_map>
 #include "regex_expression.h"
 #include "automaton.h"
 
-struct Visitor {
-    virtual void visit(CharRangeExpression *expression) = 0;
-    virtual void visit(BeginExpression *expression) = 0;
-    virtual void visit(EndExpression *expression) = 0;
-    virtual void visit(RepeatExpression *expression) = 0;
-    virtual void visit(SetExpression *expression) = 0;
-    virtual void visit(ConcatenationExpression *expression) = 0;
-    virtual void visit(SelectExpression *expression) = 0;
-};
-
-template <typename ReturnType, typename ParameterType>
-class RegexVisitor : public Visitor {
-private:
-    ReturnType returnValue;
-    ParameterType *parameterValue;
+/**
+ *  Traversal by a switch on the kind of a node: invoke() calls the
+ *  visit(XExpression *, ParameterType) of Derived for the node it is given
+ *  and hands back what that returns, with no virtual call in between and
+ *  nothing stored in the visitor, so invoke() may be reentered freely.
+**/
+template <typename Derived, typename ReturnType, typename ParameterType>
+class RegexVisitor {
 public:
     ReturnType invoke(Expression *expression, ParameterType parameter) {
-        parameterValue = &parameter;
-        expression->accept(*this);
-        return returnValue;
-    }
-
-    ReturnType invoke(typename Expression::Ptr expression, ParameterType parameter) {
-        parameterValue = &parameter;
-        expression->accept(*this);
-        return returnValue;
-    }
-
-    virtual ReturnType visit(CharRangeExpression *expression, ParameterType parameter) = 0;
-    virtual ReturnType visit(BeginExpression *expression, ParameterType parameter) = 0;
-    virtual ReturnType visit(EndExpression *expression, ParameterType parameter) = 0;
-    virtual ReturnType visit(RepeatExpression *expression, ParameterType parameter) = 0;
-    virtual ReturnType visit(SetExpression *expression, ParameterType parameter) = 0;
-    virtual ReturnType visit(ConcatenationExpression *expression, ParameterType parameter) = 0;
-    virtual ReturnType visit(SelectExpression *expression, ParameterType parameter) = 0;
-
-    /*virtual*/ void visit(CharRangeExpression *expression) {
-        returnValue = visit(expression, *parameterValue);
-    }
-    /*virtual*/ void visit(BeginExpression *expression) {
-        returnValue = visit(expression, *parameterValue);
-    }
-    /*virtual*/ void visit(EndExpression *expression) {
-        returnValue = visit(expression, *parameterValue);
-    }
-    /*virtual*/ void visit(RepeatExpression *expression) {
-        returnValue = visit(expression, *parameterValue);
-    }
-    /*virtual*/ void visit(SetExpression *expression) {
-        returnValue = visit(expression, *parameterValue);
-    }
-    /*virtual*/ void visit(ConcatenationExpression *expression) {
-        returnValue = visit(expression, *parameterValue);
-    }
-    /*virtual*/ void visit(SelectExpression *expression) {
-        returnValue = visit(expression, *parameterValue);
+        Derived *self = static_cast<Derived *>(this);
+        switch (expression->kind) {
+        case Expression::CharRange:
+            return self->visit(static_cast<CharRangeExpression *>(expression), parameter);
+        case Expression::Begin:
+            return self->visit(static_cast<BeginExpression *>(expression), parameter);
+        case Expression::End:
+            return self->visit(static_cast<EndExpression *>(expression), parameter);
+        case Expression::Repeat:
+            return self->visit(static_cast<RepeatExpression *>(expression), parameter);
+        case Expression::Set:
+            return self->visit(static_cast<SetExpression *>(expression), parameter);
+        case Expression::Concatenation:
+            return self->visit(static_cast<ConcatenationExpression *>(expression), parameter);
+        case Expression::Select:
+            return self->visit(static_cast<SelectExpression *>(expression), parameter);
+        case Expression::Group:
+            break;
+        }
+        return self->visit(static_cast<GroupExpression *>(expression), parameter);
     }
 };
 
-template <typename ParameterType>
-class RegexVisitor<void, ParameterType> : public Visitor {
-private:
-    ParameterType *parameterValue;
-public:
-    void invoke(Expression *expression, ParameterType parameter) {
-        parameterValue = &parameter;
-        expression->accept(*this);
-    }
-
-    void invoke(typename Expression::Ptr expression, ParameterType parameter) {
-        parameterValue = &parameter;
-        expression->accept(*this);
-    }
-
-    virtual void visit(CharRangeExpression *expression, ParameterType parameter) = 0;
-    virtual void visit(BeginExpression *expression, ParameterType parameter) = 0;
-    virtual void visit(EndExpression *expression, ParameterType parameter) = 0;
-    virtual void visit(RepeatExpression *expression, ParameterType parameter) = 0;
-    virtual void visit(SetExpression *expression, ParameterType parameter) = 0;
-    virtual void visit(ConcatenationExpression *expression, ParameterType parameter) = 0;
-    virtual void visit(SelectExpression *expression, ParameterType parameter) = 0;
-
-    /*virtual*/ void visit(CharRangeExpression *expression) {
-        visit(expression, *parameterValue);
-    }
-    /*virtual*/ void visit(BeginExpression *expression) {
-        visit(expression, *parameterValue);
-    }
-    /*virtual*/ void visit(EndExpression *expression) {
-        visit(expression, *parameterValue);
-    }
-    /*virtual*/ void visit(RepeatExpression *expression) {
-        visit(expression, *parameterValue);
-    }
-    /*virtual*/ void visit(SetExpression *expression) {
-        visit(expression, *parameterValue);
+/**
+ *  For the passes that work bottom-up: walk() keeps the nodes being visited
+ *  on a stack of frames, as EpsilonNfaVisitor::build() does, so no pass
+ *  recurses once per level of the tree. A visit resumes the frame on top:
+ *  it either asks for one more child with descend(), whose result is in
+ *  built on the next visit, or returns the result of its node.
+**/
+template <typename Derived, typename ReturnType>
+class FrameVisitor : public RegexVisitor<Derived, ReturnType, void *> {
+protected:
+    struct Frame {
+        Expression *expression;
+        size_t step;    // children asked for so far
+        ReturnType value;
+        std::vector<Expression::Ptr> items;
+        Frame(Expression *e) : expression(e), step(0), value() {}
+    };
+    std::vector<Frame> frames;
+    ReturnType built;
+    void descend(Expression *expression) {
+        frames.emplace_back(expression);
     }
-    /*virtual*/ void visit(ConcatenationExpression *expression) {
-        visit(expression, *parameterValue);
+    ReturnType walk(Expression *expression) {
+        size_t base = frames.size();
+        descend(expression);
+        while (frames.size() > base) {
+            size_t depth = frames.size();
+            ReturnType result = RegexVisitor<Derived, ReturnType, void *>::invoke(frames.back().expression, nullptr);
+            if (frames.size() == depth) {
+                frames.pop_back();
+                built = result;
+            }
+        }
+        return built;
     }
-    /*virtual*/ void visit(SelectExpression *expression) {
-        visit(expression, *parameterValue);
+public:
+    FrameVisitor() : built() {}
+    // the result for a whole tree; visit() alone only takes one step of it
+    ReturnType invoke(Expression *expression, void *) {
+        return walk(expression);
     }
 };
 
-class EqualsVisitor : public RegexVisitor<bool, Expression *> {
+/**
+ *  Identical nodes are equal without a look inside, which pays off on
+ *  interned trees. A visit compares the node itself and leaves the pairs of
+ *  children to equals(), which walks them off a stack.
+**/
+class EqualsVisitor : public RegexVisitor<EqualsVisitor, bool, Expression *> {
+protected:
+    std::vector<std::pair<Expression *, Expression *>> pending;
+    bool same(Expression::Ptr expression, Expression *target);
 public:
-    /*virtual*/ bool visit(CharRangeExpression *expression, Expression *);
-    /*virtual*/ bool visit(BeginExpression *expression, Expression *);
-    /*virtual*/ bool visit(EndExpression *expression, Expression *);
-    /*virtual*/ bool visit(RepeatExpression *expression, Expression *);
-    /*virtual*/ bool visit(SetExpression *expression, Expression *);
-    /*virtual*/ bool visit(ConcatenationExpression *expression, Expression *);
-    /*virtual*/ bool visit(SelectExpression *expression, Expression *);
+    bool equals(Expression *expression, Expression *target);
+    bool visit(CharRangeExpression *expression, Expression *);
+    bool visit(BeginExpression *expression, Expression *);
+    bool visit(EndExpression *expression, Expression *);
+    bool visit(RepeatExpression *expression, Expression *);
+    bool visit(SetExpression *expression, Expression *);
+    bool visit(ConcatenationExpression *expression, Expression *);
+    bool visit(SelectExpression *expression, Expression *);
+    bool visit(GroupExpression *expression, Expression *);
 };
 
-class GraphvizVisitor : public RegexVisitor<std::string, void *> {
+class GraphvizVisitor : public RegexVisitor<GraphvizVisitor, std::string, void *> {
     unsigned long id;
     std::ostream &dot;
     GraphvizVisitor(const GraphvizVisitor &);
 public:
     GraphvizVisitor(std::ostream &os, unsigned long x=0);
-    /*virtual*/ std::string visit(CharRangeExpression *expression, void *);
-    /*virtual*/ std::string visit(BeginExpression *expression, void *);
-    /*virtual*/ std::string visit(EndExpression *expression, void *);
-    /*virtual*/ std::string visit(RepeatExpression *expression, void *);
-    /*virtual*/ std::string visit(SetExpression *expression, void *);
-    /*virtual*/ std::string visit(ConcatenationExpression *expression, void *);
-    /*virtual*/ std::string visit(SelectExpression *expression, void *);
+    std::string visit(CharRangeExpression *expression, void *);
+    std::string visit(BeginExpression *expression, void *);
+    std::string visit(EndExpression *expression, void *);
+    std::string visit(RepeatExpression *expression, void *);
+    std::string visit(SetExpression *expression, void *);
+    std::string visit(ConcatenationExpression *expression, void *);
+    std::string visit(SelectExpression *expression, void *);
+    std::string visit(GroupExpression *expression, void *);
 
     static std::string repr(unsigned char c);
 };
 
-class SetNormalizationVisitor : public RegexVisitor<void, Range<unsigned char>::List *> {
+/**
+ *  A visit leaves the slots of the children on a stack rather than
+ *  recursing; normalize() drains it from the root down. Sets and steps are
+ *  virtual for SetUnificationVisitor to take over.
+**/
+class SetNormalizationVisitor : public RegexVisitor<SetNormalizationVisitor, void, Range<unsigned char>::List *> {
 protected:
-    Expression::Ptr rebuild(Expression::Ptr, unsigned char begin, unsigned char end);
+    std::vector<Expression::Ptr *> pending;
+    void rebuild(std::vector<Expression::Ptr> &items, unsigned char begin, unsigned char end);
+    void descend(Expression::Ptr &expression);
+    virtual void step(Expression::Ptr &expression, Range<unsigned char>::List *);
 public:
-    /*virtual*/ void visit(CharRangeExpression *expression, Range<unsigned char>::List *);
-    /*virtual*/ void visit(BeginExpression *expression, Range<unsigned char>::List *);
-    /*virtual*/ void visit(EndExpression *expression, Range<unsigned char>::List *);
-    /*virtual*/ void visit(RepeatExpression *expression, Range<unsigned char>::List *);
-    /*virtual*/ void visit(SetExpression *expression, Range<unsigned char>::List *);
-    /*virtual*/ void visit(ConcatenationExpression *expression, Range<unsigned char>::List *);
-    /*virtual*/ void visit(SelectExpression *expression, Range<unsigned char>::List *);
+    void normalize(Expression::Ptr expression, Range<unsigned char>::List *);
+    void visit(CharRangeExpression *expression, Range<unsigned char>::List *);
+    void visit(BeginExpression *expression, Range<unsigned char>::List *);
+    void visit(EndExpression *expression, Range<unsigned char>::List *);
+    void visit(RepeatExpression *expression, Range<unsigned char>::List *);
+    virtual void visit(SetExpression *expression, Range<unsigned char>::List *);
+    void visit(ConcatenationExpression *expression, Range<unsigned char>::List *);
+    void visit(SelectExpression *expression, Range<unsigned char>::List *);
+    void visit(GroupExpression *expression, Range<unsigned char>::List *);
 };
 
 class SetUnificationVisitor : public SetNormalizationVisitor {
+protected:
+    /*virtual*/ void step(Expression::Ptr &expression, Range<unsigned char>::List *);
 public:
+    using SetNormalizationVisitor::visit;
     /*virtual*/ void visit(SetExpression *expression, Range<unsigned char>::List *);
 };
 
-class EpsilonNfaVisitor : public RegexVisitor<EpsilonNfa, Automaton *> {
+class GroupNumberingVisitor : public RegexVisitor<GroupNumberingVisitor, void, int32_t *> {
+protected:
+    std::vector<Expression::Ptr> pending;
+public:
+    int32_t number(Expression::Ptr expression);
+    void visit(CharRangeExpression *expression, int32_t *);
+    void visit(BeginExpression *expression, int32_t *);
+    void visit(EndExpression *expression, int32_t *);
+    void visit(RepeatExpression *expression, int32_t *);
+    void visit(SetExpression *expression, int32_t *);
+    void visit(ConcatenationExpression *expression, int32_t *);
+    void visit(SelectExpression *expression, int32_t *);
+    void visit(GroupExpression *expression, int32_t *);
+};
+
+class FactorizationVisitor : public FrameVisitor<FactorizationVisitor, Expression::Ptr> {
+public:
+    using Factors = std::vector<Expression::Ptr>;
+protected:
+    void alternatives(SelectExpression *expression, std::vector<Expression::Ptr> &alters);
+    void factors(Expression::Ptr expression, Factors &facts);
+    Expression::Ptr concatenate(Factors::const_iterator begin, Factors::const_iterator end);
+    Expression::Ptr optional(Expression::Ptr expression, bool isGreedy);
+    bool hoppable(Expression::Ptr a, Expression::Ptr b);
+    bool hoistable(Expression::Ptr head);
+    Expression::Ptr merge(std::vector<Factors> alters);
+    Expression::Ptr mergeSuffixes(std::vector<Factors> alters);
+public:
+    Expression::Ptr visit(CharRangeExpression *expression, void *);
+    Expression::Ptr visit(BeginExpression *expression, void *);
+    Expression::Ptr visit(EndExpression *expression, void *);
+    Expression::Ptr visit(RepeatExpression *expression, void *);
+    Expression::Ptr visit(SetExpression *expression, void *);
+    Expression::Ptr visit(ConcatenationExpression *expression, void *);
+    Expression::Ptr visit(SelectExpression *expression, void *);
+    Expression::Ptr visit(GroupExpression *expression, void *);
+};
+
+class StructuralHashVisitor : public FrameVisitor<StructuralHashVisitor, uint64_t> {
+public:
+    static uint64_t mix(uint64_t hash, uint64_t value);
+    uint64_t visit(CharRangeExpression *expression, void *);
+    uint64_t visit(BeginExpression *expression, void *);
+    uint64_t visit(EndExpression *expression, void *);
+    uint64_t visit(RepeatExpression *expression, void *);
+    uint64_t visit(SetExpression *expression, void *);
+    uint64_t visit(ConcatenationExpression *expression, void *);
+    uint64_t visit(SelectExpression *expression, void *);
+    uint64_t visit(GroupExpression *expression, void *);
+};
+
+/**
+ *  Hash-consing: interns children first, so a node only has to be compared
+ *  with the nodes of its hash whose children are the very same pointers.
+ *  Equal subtrees of everything interned through one visitor end up as one
+ *  node; passes that rewrite in place then see shared nodes, which all the
+ *  passes here tolerate since none depends on where a node hangs.
+**/
+class InterningVisitor : public FrameVisitor<InterningVisitor, Expression::Ptr> {
+protected:
+    std::unordered_multimap<uint64_t, Expression::Ptr> table;
+    std::unordered_map<Expression *, uint64_t> hashes;
+    Expression::Ptr intern(Expression::Ptr expression, uint64_t hash);
+    uint64_t childHash(Expression::Ptr expression);
+public:
+    Expression::Ptr intern(Expression::Ptr expression);
+    // the structural hash of an interned node, remembered
+    uint64_t hash(Expression::Ptr expression);
+    size_t size() const {
+        return table.size();
+    }
+    Expression::Ptr visit(CharRangeExpression *expression, void *);
+    Expression::Ptr visit(BeginExpression *expression, void *);
+    Expression::Ptr visit(EndExpression *expression, void *);
+    Expression::Ptr visit(RepeatExpression *expression, void *);
+    Expression::Ptr visit(SetExpression *expression, void *);
+    Expression::Ptr visit(ConcatenationExpression *expression, void *);
+    Expression::Ptr visit(SelectExpression *expression, void *);
+    Expression::Ptr visit(GroupExpression *expression, void *);
+};
+
+// how many states EpsilonNfaVisitor would build for a tree, tags aside
+class NfaSizeVisitor : public FrameVisitor<NfaSizeVisitor, int64_t> {
+public:
+    int64_t visit(CharRangeExpression *expression, void *);
+    int64_t visit(BeginExpression *expression, void *);
+    int64_t visit(EndExpression *expression, void *);
+    int64_t visit(RepeatExpression *expression, void *);
+    int64_t visit(SetExpression *expression, void *);
+    int64_t visit(ConcatenationExpression *expression, void *);
+    int64_t visit(SelectExpression *expression, void *);
+    int64_t visit(GroupExpression *expression, void *);
+};
+
+struct SimplificationStatistics {
+    enum Rule {
+        NestedRepeat,           // (x*)* => x*, (x?)? => x?, (x+)? => x* ...
+        UnitRepeat,             // x{1} => x
+        DuplicateAlternative,   // x|y|x => x|y
+        MergeRanges,            // [a-c]|[b-d]|e => [a-e]
+        RedundantSet,           // [a] => a, [[a-z]] => [a-z]
+        EmptySet,               // x[]y => xy, []* => []
+        Ungroup,                // (x) => x when nothing captures
+        RuleCount
+    };
+    size_t rewrites[RuleCount];
+    // NFA states, as NfaSizeVisitor counts them before set normalization
+    int64_t statesSaved[RuleCount];
+    SimplificationStatistics();
+};
+
+/**
+ *  Rewrites bottom-up with rules that keep both the language and the
+ *  priorities of leftmost-first matching; simplify() reapplies it until
+ *  nothing changes.
+**/
+class SimplificationVisitor : public FrameVisitor<SimplificationVisitor, Expression::Ptr> {
+protected:
+    bool keepGroups;
+    SimplificationStatistics *statistics;
+    size_t changes;
+    // NFA states of an expression, only counted when there are statistics to keep
+    int64_t states(Expression::Ptr expression);
+    void rewrite(SimplificationStatistics::Rule rule, int64_t before, int64_t after);
+    void alternatives(const std::vector<Expression::Ptr> &items, std::vector<Expression::Ptr> &alters);
+public:
+    SimplificationVisitor(bool keepGroups, SimplificationStatistics *statistics);
+    size_t getChanges() const {
+        return changes;
+    }
+    void resetChanges() {
+        changes = 0;
+    }
+    Expression::Ptr visit(CharRangeExpression *expression, void *);
+    Expression::Ptr visit(BeginExpression *expression, void *);
+    Expression::Ptr visit(EndExpression *expression, void *);
+    Expression::Ptr visit(RepeatExpression *expression, void *);
+    Expression::Ptr visit(SetExpression *expression, void *);
+    Expression::Ptr visit(ConcatenationExpression *expression, void *);
+    Expression::Ptr visit(SelectExpression *expression, void *);
+    Expression::Ptr visit(GroupExpression *expression, void *);
+};
+
+/**
+ *  A tagged NFA brackets group k with Tag 2(k-1) on entry and Tag 2(k-1)+1
+ *  on exit.
+ *  build() keeps the nodes under construction on a stack of frames. A
+ *  visit resumes the frame on top: it either asks for one more child with
+ *  descend(), whose NFA is in built on the next visit, or returns the NFA
+ *  of its node.
+**/
+class EpsilonNfaVisitor : public RegexVisitor<EpsilonNfaVisitor, EpsilonNfa, Automaton *> {
+    struct Frame {
+        Expression *expression;
+        size_t step;    // children asked for so far
+        EpsilonNfa nfa;
+        State::Ptr exit;
+        std::vector<EpsilonNfa> alternatives;
+        Frame(Expression *e) : expression(e), step(0) {}
+    };
+    bool tagged;
+    std::vector<Frame> frames;
+    EpsilonNfa built;
+    void descend(Expression *expression);
 public:
+    EpsilonNfaVisitor(bool tagged=false);
+    EpsilonNfa build(Expression *expression, Automaton *);
     EpsilonNfa connect(EpsilonNfa, EpsilonNfa, Automaton *);
-    /*virtual*/ EpsilonNfa visit(CharRangeExpression *expression, Automaton *);
-    /*virtual*/ EpsilonNfa visit(BeginExpression *expression, Automaton *);
-    /*virtual*/ EpsilonNfa visit(EndExpression *expression, Automaton *);
-    /*virtual*/ EpsilonNfa visit(RepeatExpression *expression, Automaton *);
-    /*virtual*/ EpsilonNfa visit(SetExpression *expression, Automaton *);
-    /*virtual*/ EpsilonNfa visit(ConcatenationExpression *expression, Automaton *);
-    /*virtual*/ EpsilonNfa visit(SelectExpression *expression, Automaton *);
+    EpsilonNfa visit(CharRangeExpression *expression, Automaton *);
+    EpsilonNfa visit(BeginExpression *expression, Automaton *);
+    EpsilonNfa visit(EndExpression *expression, Automaton *);
+    EpsilonNfa visit(RepeatExpression *expression, Automaton *);
+    EpsilonNfa visit(SetExpression *expression, Automaton *);
+    EpsilonNfa visit(ConcatenationExpression *expression, Automaton *);
+    EpsilonNfa visit(SelectExpression *expression, Automaton *);
+    EpsilonNfa visit(GroupExpression *expression, Automaton *);
 };
 
 #endif
@@ -0,0 +1,23 @@
+#ifndef REGEX_CODEGEN_H
+#define REGEX_CODEGEN_H
+
+#include <iosfwd>
+#include <string>
+#include "regex_interpreter.h"
+
+/**
+ *  Writes a standalone C++ header recognizing the language of interpreter's
+ *  tables as a direct-coded switch/goto state machine, in the manner of
+ *  re2c. The generated nameHead, nameMatch and nameSearch mirror
+ *  searchHead, match and search of PoorInterpreter and need nothing beyond
+ *  <cstddef>. The DFA it was built from must be free of anchors (see
+ *  Automaton::hasAnchors).
+**/
+extern void generateCpp(const PoorInterpreter &interpreter, const std::string &name, std::ostream &os);
+
+/**
+ *  Writes the tables of interpreter as constexpr arrays together with a
+ *  constexpr StaticInterpreter over them (see static_interpreter.h).
+**/
+extern void generateTables(const PoorInterpreter &interpreter, const std::string &name, std::ostream &os);
+#endif
@@ -0,0 +1,168 @@
+#ifndef REGEX_COMPILER_H
+#define REGEX_COMPILER_H
+
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "regex_interpreter.h"
+
+/**
+ *  Automatic determinizes forward under a state budget proportional to the
+ *  NFA and falls back to Brzozowski when the budget runs out, which is when
+ *  the subset construction blows up and minimizing after it costs most.
+**/
+enum class Minimization {
+    Automatic,
+    Hopcroft,
+    Brzozowski
+};
+
+/**
+ *  Which match is reported among those starting at the leftmost offset:
+ *  the longest (POSIX), or the one a backtracking engine finds first given
+ *  the order of alternatives and the greediness of quantifiers (Perl).
+**/
+enum class Semantics {
+    LeftmostLongest,
+    LeftmostFirst
+};
+
+/**
+ *  Knobs of compile(). Every field that changes the produced DFA takes
+ *  part in the cache key; cacheDirectory only says where to look.
+**/
+struct CompileOptions {
+    bool factorize;
+    Minimization minimization;
+    Semantics semantics;
+    std::string cacheDirectory;
+    CompileOptions() : factorize(true), minimization(Minimization::Automatic), semantics(Semantics::LeftmostLongest) {}
+};
+
+extern Automaton::Ptr compileDfa(const std::string &pattern, const CompileOptions &options=CompileOptions());
+extern uint64_t compileKey(const std::string &pattern, const CompileOptions &options);
+extern std::string cachePath(const std::string &pattern, const CompileOptions &options);
+extern PoorInterpreter::Ptr compile(const std::string &pattern, const CompileOptions &options=CompileOptions());
+
+class BidirectionalSearcher {
+public:
+    using Result = PoorInterpreter::Result;
+protected:
+    PoorInterpreter::ConstPtr forward;
+    PoorInterpreter::ConstPtr reverse;
+    PoorInterpreter::ConstPtr reverseUnanchored;
+    bool anchoredAtEnd;
+    BidirectionalSearcher(const BidirectionalSearcher &);
+    void scanForward(const char *input, size_t start, size_t end, Result *result) const;
+public:
+    BidirectionalSearcher(const std::string &pattern, const CompileOptions &options=CompileOptions());
+    bool isAnchoredAtEnd() const {
+        return anchoredAtEnd;
+    }
+    bool search(const char *input, size_t length, Result *result=nullptr) const;
+    bool searchEndingAt(const char *input, size_t end, Result *result=nullptr) const;
+};
+
+/**
+ *  Capture groups by a tagged DFA (Laurikari). Group k brackets itself with
+ *  tags 2(k-1) and 2(k-1)+1 in the NFA; a DFA state is the ordered list of
+ *  NFA threads alive after the same input, each owning one register per
+ *  tag, and every transition carries the operations that carry registers
+ *  over to the threads they continue or set them to the position. One pass
+ *  over the text extracts the groups under leftmost-first semantics, a
+ *  repeated group reporting its last iteration. When no state has two
+ *  threads reading the same byte the pattern is one-pass: a single bank of
+ *  registers then suffices, written in place only by the thread that reads.
+**/
+class TaggedInterpreter {
+public:
+    using Ptr = std::shared_ptr<TaggedInterpreter>;
+    using ConstPtr = std::shared_ptr<const TaggedInterpreter>;
+    // -1 for both when the group took no part in the match
+    struct Capture {
+        int32_t start;
+        int32_t length;
+    };
+    using Captures = std::vector<Capture>;
+    static constexpr int32_t InvalidState = -1;
+protected:
+    // registers[target] = registers[source], or the position for SetPosition
+    struct Operation {
+        int32_t target;
+        int32_t source;
+    };
+    using Operations = std::vector<Operation>;
+    static constexpr int32_t SetPosition = -1;
+    static constexpr int32_t Clear = -2;
+    PoorInterpreter::ConstPtr matcher;
+    int32_t groupCount;
+    int32_t tagCount;
+    int32_t registerCount;
+    int32_t stateCount;
+    int32_t charCategories;
+    int32_t startState;
+    int32_t beginState;
+    bool onePass;
+    int16_t charMap[PoorInterpreter::CharMapSize];
+    std::vector<int32_t> transitions;
+    std::vector<Operations> transitionOperations;
+    // the register bank holding the tags of the accepting thread, or -1
+    std::vector<int32_t> acceptedBase;
+    std::vector<Operations> acceptOperations;
+    Operations startOperations;
+    Operations beginOperations;
+    TaggedInterpreter(const TaggedInterpreter &);
+    static void apply(const Operations &operations, const int32_t *from, int32_t *to, int32_t position);
+public:
+    TaggedInterpreter(const std::string &pattern, const CompileOptions &options=CompileOptions());
+    int32_t getGroupCount() const {
+        return groupCount;
+    }
+    int32_t getStateCount() const {
+        return stateCount;
+    }
+    bool isOnePass() const {
+        return onePass;
+    }
+    bool searchHead(const char *input, Captures &captures, uint32_t offset=0) const;
+    bool search(const char *input, Captures &captures, uint32_t offset=0) const;
+};
+
+/**
+ *  Thread-safe LRU of compiled interpreters keyed by pattern and options,
+ *  bounded by the total size of their tables. Programs are shared and
+ *  immutable, so an evicted one stays valid for whoever still holds it.
+ *  Compiling happens outside the lock; threads missing on the same key at
+ *  once may both compile, and the first to finish wins.
+**/
+class CompileCache {
+public:
+    struct Statistics {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t evictions;
+        size_t entries;
+        size_t bytes;
+    };
+protected:
+    struct Entry {
+        std::string key;
+        PoorInterpreter::ConstPtr interpreter;
+        size_t bytes;
+    };
+    std::list<Entry> entries;
+    std::unordered_map<std::string, std::list<Entry>::iterator> index;
+    size_t capacity;
+    Statistics statistics;
+    mutable std::mutex mutex;
+    CompileCache(const CompileCache &);
+    static std::string makeKey(const std::string &pattern, const CompileOptions &options);
+public:
+    explicit CompileCache(size_t capacity);
+    PoorInterpreter::ConstPtr get(const std::string &pattern, const CompileOptions &options=CompileOptions());
+    Statistics getStatistics() const;
+    void clear();
+};
+#endif
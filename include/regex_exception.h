@@ -11,4 +11,12 @@ public:
     const char *what() const noexcept;
     virtual ~LexerException() {}
 };
+
+class InterpreterException : public std::exception {
+    std::string message;
+public:
+    explicit InterpreterException (const std::string m);
+    const char *what() const noexcept;
+    virtual ~InterpreterException() {}
+};
 #endif
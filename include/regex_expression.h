@@ -1,65 +1,167 @@
 #ifndef REGEX_EXPRESSION_H
 #define REGEX_EXPRESSION_H
 
+#include <algorithm>
 #include <cstdint>
+#include <iterator>
 #include <memory>
 #include <iosfwd>
+#include <vector>
 #include "container.h"
 #include "automaton.h"
 
-class Visitor;
+struct SimplificationStatistics;
 
+// the largest count a {m,n} repetition may give
+constexpr int32_t MaxRepetition = 1000;
+
+/**
+ *  Bump allocator owning every node built while it is the current arena of
+ *  its thread. Nodes are never freed one by one, so the tree holds plain
+ *  pointers and the whole of it goes with the arena. Building a node with
+ *  no arena in scope throws std::logic_error; whoever parses or writes a
+ *  tree opens the Scope that decides how long it lives.
+**/
+class ExpressionArena {
+    std::vector<std::unique_ptr<char[]>> chunks;
+    char *cursor;
+    size_t left;
+    size_t used;
+    ExpressionArena(const ExpressionArena &);
+    ExpressionArena &operator=(const ExpressionArena &);
+public:
+    static constexpr size_t ChunkSize = 64 << 10;
+    class Scope {
+        ExpressionArena *saved;
+        Scope(const Scope &);
+    public:
+        explicit Scope(ExpressionArena &arena);
+        ~Scope();
+    };
+    ExpressionArena();
+    void *allocate(size_t size);
+    size_t bytes() const {
+        return used;
+    }
+    static ExpressionArena &current();
+};
+
+/**
+ *  Nodes carry their kind instead of a vtable; passes switch on it (see
+ *  RegexVisitor) and expressionCast() stands in for dynamic_cast.
+**/
 struct Expression {
-    typedef std::shared_ptr<Expression> Ptr;
+    typedef Expression *Ptr;
+    enum Kind : uint8_t {
+        CharRange, Begin, End, Repeat, Set, Concatenation, Select, Group
+    };
+    const Kind kind;
+    explicit Expression(Kind k) : kind(k) {}
+    static void *operator new(size_t size);
+    static void operator delete(void *) {}
     bool equals(Expression *);
     void graphviz(std::ostream &os);
     void setNormalize(Range<unsigned char>::List *unifiedRanges);
     void setUnify(Range<unsigned char>::List unifiedRanges);
-    Automaton::Ptr generateEpsilonNfa();
-    virtual void accept(Visitor &) = 0;
+    Automaton::Ptr generateEpsilonNfa(bool tagged=false);
+};
+
+/**
+ *  The children of an n-ary node, copied into the current arena when the
+ *  node is built. Their number is fixed from then on; rewriting passes
+ *  replace them in place.
+**/
+class ExpressionList {
+    Expression::Ptr *items;
+    size_t count;
+public:
+    ExpressionList() : items(nullptr), count(0) {}
+    template <typename Iterator>
+    ExpressionList(Iterator begin, Iterator end) : items(nullptr), count(std::distance(begin, end)) {
+        if (count)
+            items = static_cast<Expression::Ptr *>(ExpressionArena::current().allocate(count * sizeof(Expression::Ptr)));
+        std::copy(begin, end, items);
+    }
+    Expression::Ptr *begin() const {
+        return items;
+    }
+    Expression::Ptr *end() const {
+        return items + count;
+    }
+    size_t size() const {
+        return count;
+    }
+    Expression::Ptr &operator[](size_t i) const {
+        return items[i];
+    }
+    Expression::Ptr &front() const {
+        return items[0];
+    }
+    Expression::Ptr &back() const {
+        return items[count - 1];
+    }
 };
 
 struct CharRangeExpression : public Expression {
+    static constexpr Kind Tag = CharRange;
     Range<unsigned char> range;
     CharRangeExpression();
     CharRangeExpression(unsigned char b, unsigned char e);
-    /*virtual*/ void accept(Visitor &);
 };
 
 struct BeginExpression : public Expression {
-    /*virtual*/ void accept(Visitor &);
+    static constexpr Kind Tag = Begin;
+    BeginExpression() : Expression(Tag) {}
 };
 
 struct EndExpression : public Expression {
-    /*virtual*/ void accept(Visitor &);
+    static constexpr Kind Tag = End;
+    EndExpression() : Expression(Tag) {}
 };
 
 struct RepeatExpression : public Expression {
-    Expression::Ptr expression;
+    static constexpr Kind Tag = Repeat;
+    Expression::Ptr expression = nullptr;
     Range<int32_t> times;
     bool isGreedy;
     RepeatExpression(int32_t min, int32_t max, bool isGreedy);
-    /*virtual*/ void accept(Visitor &);
 };
 
 struct SetExpression : public Expression {
-    Expression::Ptr expression;
+    static constexpr Kind Tag = Set;
+    Expression::Ptr expression = nullptr;
     bool isComplementary;
-    /*virtual*/ void accept(Visitor &);
+    SetExpression() : Expression(Tag) {}
 };
 
+// two or more items in a row, none of them a concatenation or empty
 struct ConcatenationExpression : public Expression {
-    Expression::Ptr left;
-    Expression::Ptr right;
-    /*virtual*/ void accept(Visitor &);
+    static constexpr Kind Tag = Concatenation;
+    ExpressionList items;
+    ConcatenationExpression() : Expression(Tag) {}
 };
 
+// two or more alternatives in order of priority, none of them a select;
+// an empty alternative is a null item
 struct SelectExpression : public Expression {
-    Expression::Ptr left;
-    Expression::Ptr right;
-    /*virtual*/ void accept(Visitor &);
+    static constexpr Kind Tag = Select;
+    ExpressionList items;
+    SelectExpression() : Expression(Tag) {}
+};
+
+struct GroupExpression : public Expression {
+    static constexpr Kind Tag = Group;
+    Expression::Ptr expression = nullptr;
+    int32_t index;
+    GroupExpression(int32_t index=0);
 };
 
+// the node as a T if it is one, null otherwise or for a null node
+template <typename T>
+T *expressionCast(Expression *expression) {
+    return expression && expression->kind == T::Tag ? static_cast<T *>(expression) : nullptr;
+}
+
 std::string repr(unsigned char c);
 std::string repr(const std::string &input);
 extern bool isChar(const char *&input, char);
@@ -72,4 +174,9 @@ extern Expression::Ptr parseBasicRE(const char *&input);
 extern Expression::Ptr parseSimpleRE(const char *&input);
 extern Expression::Ptr parseRE(const char *&input);
 extern Expression::Ptr parseRegex(const std::string &str);
+extern Expression::Ptr concatenate(const std::vector<Expression::Ptr> &items);
+extern Expression::Ptr alternate(const std::vector<Expression::Ptr> &alternatives);
+extern int32_t numberGroups(Expression::Ptr expression);
+extern Expression::Ptr factorize(Expression::Ptr expression);
+extern Expression::Ptr simplify(Expression::Ptr expression, bool keepGroups=false, SimplificationStatistics *statistics=nullptr);
 #endif
@@ -2,31 +2,224 @@
 #define REGEX_INTERPRETER_H
 
 #include <vector>
+#include <string>
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <unordered_set>
 #include "automaton.h"
 
 class PoorInterpreter {
 public:
     using Ptr = std::shared_ptr<PoorInterpreter>;
+    using ConstPtr = std::shared_ptr<const PoorInterpreter>;
     struct Result {
         int32_t start;
         int32_t length;
         int32_t terminateState;
         int32_t acceptedState;
     };
+    using Callback = std::function<void(const Result &)>;
 protected:
-    std::vector<int16_t> charMap;
-    std::vector<std::vector<int32_t>> transitionTable;
-    std::vector<bool> acceptedStates;
+    /**
+     *  The tables live in one position-independent image: this header, then
+     *  the byte-class map, the transition table, the accept table, the
+     *  accept-at-end table and the label, each 8-byte aligned. A compiled
+     *  interpreter owns its image on the heap; a loaded one runs straight on
+     *  the read-only mapping of the file.
+    **/
+    struct ImageHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t byteOrder;
+        int32_t stateCount;
+        int32_t charCategories;
+        int32_t startState;
+        int32_t beginState;
+        uint32_t flags;
+        uint32_t reserved;
+        uint64_t charMapOffset;
+        uint64_t transitionOffset;
+        uint64_t acceptedOffset;
+        uint64_t acceptedAtEndOffset;
+        uint64_t labelOffset;
+        uint64_t labelSize;
+        uint64_t size;
+    };
+    // no match can start past offset 0: the start state never accepts
+    static constexpr uint32_t AnchoredAtBegin = 1;
+    std::shared_ptr<const char> image;
+    const int16_t *charMap;
+    const int32_t *transitionTable;
+    const uint8_t *acceptedStates;
+    const uint8_t *acceptedAtEnd;
     int32_t stateCount;
     int32_t charCategories;
     int32_t startState;
+    int32_t beginState;
+    bool anchoredAtBegin;
+    PoorInterpreter(std::shared_ptr<const char> image);
+    static void layout(ImageHeader &header);
+    void bind();
+    bool scanHead(const char *input, Result *result, uint32_t offset) const;
+    bool scanHead(const char *input, size_t length, Result *result, uint32_t offset) const;
+    template <typename Offset>
+    size_t scanColumn(const char *data, const Offset *offsets, size_t rows, uint8_t *bitmap, Result *spans) const;
 public:
     static constexpr int CharMapSize = 256;
     static constexpr int InvalidState = -1;
+    static constexpr int BatchWidth = 8;
+    static constexpr uint32_t FormatVersion = 3;
+    /**
+     *  Anchors are compiled into the tables: matching at offset 0 starts in
+     *  the begin state, which has followed ^, and elsewhere in the start
+     *  state, where ^ is dead. $ only counts at the end of input, where
+     *  acceptance is read from the accept-at-end table instead.
+    **/
     PoorInterpreter(Automaton::Ptr dfa);
-    bool match(const char *input);
-    bool search(const char *input, Result *result=nullptr, uint32_t offset=0);
-    bool searchHead(const char *input, Result *result=nullptr, uint32_t offset=0); 
+    /**
+     *  label is stored with the tables as is and read back by getLabel(),
+     *  so whoever keeps images around can tell what each was built from.
+    **/
+    void save(std::ostream &os, const std::string &label=std::string()) const;
+    static Ptr load(const std::string &path);
+    bool match(const char *input) const;
+    bool search(const char *input, Result *result=nullptr, uint32_t offset=0) const;
+    bool searchHead(const char *input, Result *result=nullptr, uint32_t offset=0) const;
+    size_t searchAll(const char *input, Callback callback) const;
+    size_t searchOverlapping(const char *input, Callback callback) const;
+    size_t parallelSearchAll(const char *input, unsigned threads, Callback callback) const;
+    void searchHeadBatch(const char *const *inputs, size_t count, Result *results, bool prefetch=true) const;
+    size_t searchColumn(const char *data, const int32_t *offsets, size_t rows, uint8_t *bitmap, Result *spans=nullptr) const;
+    size_t searchColumn(const char *data, const int64_t *offsets, size_t rows, uint8_t *bitmap, Result *spans=nullptr) const;
+
+    size_t memorySize() const {
+        return reinterpret_cast<const ImageHeader *>(image.get())->size;
+    }
+    std::string getLabel() const {
+        const ImageHeader *header = reinterpret_cast<const ImageHeader *>(image.get());
+        return std::string(image.get() + header->labelOffset, header->labelSize);
+    }
+    int32_t getStartState() const {
+        return startState;
+    }
+    int32_t getBeginState() const {
+        return beginState;
+    }
+    int32_t getStartState(uint32_t offset) const {
+        return offset ? startState : beginState;
+    }
+    bool isAnchoredAtBegin() const {
+        return anchoredAtBegin;
+    }
+    int32_t getStateCount() const {
+        return stateCount;
+    }
+    int32_t getCharCategories() const {
+        return charCategories;
+    }
+    int16_t getCharCategory(unsigned char c) const {
+        return charMap[c];
+    }
+    int32_t getTransition(int32_t state, int32_t category) const {
+        return transitionTable[state * charCategories + category];
+    }
+    bool isAccepted(int32_t state) const {
+        return acceptedStates[state];
+    }
+    bool isAcceptedAtEnd(int32_t state) const {
+        return acceptedAtEnd[state];
+    }
+    int32_t transit(int32_t state, unsigned char c) const {
+        return transitionTable[state * charCategories + charMap[c]];
+    }
+};
+
+class StreamMatcher {
+public:
+    struct Match {
+        uint64_t start;
+        uint64_t length;
+        int32_t terminateState;
+        int32_t acceptedState;
+    };
+    using Callback = std::function<void(const Match &)>;
+protected:
+    friend class PoorInterpreter;
+    static constexpr uint64_t NoMatch = ~uint64_t(0);
+    /**
+     *  A match attempt started at offset start. Attempts in the same DFA
+     *  state share their future, so they are kept in one group per state
+     *  and the group is what moves; an attempt only records where its
+     *  longest match ended when it leaves its group.
+    **/
+    struct Attempt {
+        uint64_t start;
+        uint64_t end;
+        uint64_t joined;
+        int32_t group;
+        int32_t terminateState;
+        int32_t acceptedState;
+        int32_t previous;
+        int32_t next;
+        int32_t previousInGroup;
+        int32_t nextInGroup;
+    };
+    struct Group {
+        int32_t state;
+        int32_t head;
+        int32_t tail;
+        int32_t size;
+        int32_t fresh;
+        int32_t acceptedState;
+        uint64_t accepted;
+    };
+    const PoorInterpreter *table;
+    PoorInterpreter::ConstPtr interpreter;
+    Callback callback;
+    bool emptyMatches;
+    std::vector<Attempt> attempts;
+    std::vector<Group> groups;
+    int32_t freeAttempt;
+    int32_t freeGroup;
+    int32_t first;
+    int32_t last;
+    std::vector<int32_t> stateGroup, nextStateGroup;
+    std::vector<int32_t> live, nextLive;
+    std::vector<Match> ready;
+    uint64_t offset;
+    uint64_t boundary;
+    size_t pending;
+    StreamMatcher(const PoorInterpreter &table, bool emptyMatches);
+    size_t skip(const char *input, size_t length);
+    void step(unsigned char c);
+    void end();
+    void commit();
+    void clear();
+    uint64_t endOf(int32_t attempt) const;
+    bool isFresh(int32_t attempt) const;
+    void detach(int32_t attempt);
+    void attach(int32_t attempt, int32_t group, uint64_t joined);
+    int32_t spawn(uint64_t start, uint64_t joined, int32_t group);
+    void release(int32_t attempt);
+    int32_t makeGroup(int32_t state);
+    void kill(int32_t group, int32_t terminateState);
+    void merge(int32_t from, int32_t into);
+public:
+    /**
+     *  Reports the same matches as PoorInterpreter::searchAll over the
+     *  concatenation of every chunk fed, without keeping any input: each
+     *  undecided match is held as a start offset plus a DFA state. Memory
+     *  is bounded by the matches still undecided, which dominance between
+     *  attempts keeps to a handful for typical token patterns; see size().
+    **/
+    StreamMatcher(PoorInterpreter::ConstPtr interpreter, Callback callback);
+    void feed(const char *input, size_t length);
+    void finish();
+    void reset();
+    size_t size() const {
+        return pending;
+    }
 };
 
 class RichInterpreter {
@@ -42,16 +235,30 @@ public:
         State::Ptr state;
         const char *reading;
         Transition::List::iterator transition;
+        size_t entered;
     };
+    using Callback = std::function<void(const Result &)>;
 protected:
+    /**
+     *  (state, offset) pairs from which no match can be completed. Whether
+     *  one can only depends on the pair, so what an attempt rules out holds
+     *  for every later attempt as well.
+    **/
+    struct FailureMemo {
+        std::unordered_set<uint64_t> failed;
+        std::vector<uint64_t> entered;
+        uint64_t horizon;
+    };
     Automaton::Ptr dfa;
     std::unordered_map<State::Ptr, int32_t> stateMap;
     std::vector<bool> savedMap;
+    bool searchHead(const char *input, Result *result, uint32_t offset, std::vector<StatusSaver> &statusStack, FailureMemo *memo=nullptr);
 public:
     RichInterpreter(Automaton::Ptr dfa);
     bool match(const char *input);
     bool search(const char *input, Result *result=nullptr, uint32_t offset=0);
     bool searchHead(const char *input, Result *result=nullptr, uint32_t offset=0); 
+    size_t searchAll(const char *input, Callback callback);
 };
 
 #endif
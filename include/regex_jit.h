@@ -0,0 +1,46 @@
+#ifndef REGEX_JIT_H
+#define REGEX_JIT_H
+
+#include <memory>
+#include "regex_interpreter.h"
+
+/**
+ *  Lowers the tables of a PoorInterpreter into x86-64 machine code: one
+ *  basic block per state dispatching on the byte with a compare chain, and
+ *  an SSE2 scan loop for states that loop on themselves for all but a few
+ *  bytes. Code is emitted into an anonymous mapping that is made executable
+ *  only once written. Where that is impossible (another architecture, or a
+ *  system refusing executable mappings) or when disabled, every call falls
+ *  back to the table interpreter, with identical results.
+**/
+class JitInterpreter {
+public:
+    using Ptr = std::shared_ptr<JitInterpreter>;
+    using Result = PoorInterpreter::Result;
+    using Callback = PoorInterpreter::Callback;
+protected:
+    struct Output {
+        int64_t length;
+        int32_t terminateState;
+        int32_t acceptedState;
+    };
+    using Function = void (*)(const char *input, Output *output, int32_t atBegin);
+    PoorInterpreter::ConstPtr interpreter;
+    std::shared_ptr<void> code;
+    Function function;
+    JitInterpreter(const JitInterpreter &);
+    bool compile();
+    bool scanHead(const char *input, Result *result, uint32_t offset) const;
+public:
+    static constexpr int MaxScanStops = 3;
+    JitInterpreter(PoorInterpreter::ConstPtr interpreter, bool enable=true);
+    bool isCompiled() const {
+        return function != nullptr;
+    }
+    bool match(const char *input) const;
+    bool search(const char *input, Result *result=nullptr, uint32_t offset=0) const;
+    bool searchHead(const char *input, Result *result=nullptr, uint32_t offset=0) const;
+    size_t searchAll(const char *input, Callback callback) const;
+};
+
+#endif
@@ -10,6 +10,7 @@ struct RegexNode {
     RegexNode zeroOrMore(bool isGreedy=true) const;
     RegexNode zeroOrOne(bool isGreedy=true) const;
     RegexNode repeat(int32_t min, int32_t max, bool isGreedy=true) const;
+    RegexNode group(int32_t index=0) const;
     RegexNode operator+(RegexNode node) const;
     RegexNode operator|(RegexNode node) const;
     RegexNode operator<<=(RegexNode node) const;
@@ -0,0 +1,99 @@
+#ifndef STATIC_INTERPRETER_H
+#define STATIC_INTERPRETER_H
+
+#include <cstdint>
+#include <cstring>
+#include "regex_interpreter.h"
+
+/**
+ *  PoorInterpreter over tables fixed at build time. toy-yacc --tables emits
+ *  them as constexpr arrays, so they are placed in .rodata and a constexpr
+ *  StaticInterpreter needs no compile step at all. Header-only: nothing of
+ *  the library is linked, and results are PoorInterpreter::Result.
+**/
+class StaticInterpreter {
+public:
+    using Result = PoorInterpreter::Result;
+    static constexpr int InvalidState = PoorInterpreter::InvalidState;
+protected:
+    const int16_t *charMap;
+    const int32_t *transitionTable;
+    const uint8_t *acceptedStates;
+    const uint8_t *acceptedAtEnd;
+    int32_t stateCount;
+    int32_t charCategories;
+    int32_t startState;
+    int32_t beginState;
+    bool anchoredAtBegin;
+public:
+    constexpr StaticInterpreter(const int16_t *_charMap, const int32_t *_transitionTable, const uint8_t *_acceptedStates,
+            const uint8_t *_acceptedAtEnd, int32_t _stateCount, int32_t _charCategories, int32_t _startState,
+            int32_t _beginState, bool _anchoredAtBegin)
+        : charMap(_charMap), transitionTable(_transitionTable), acceptedStates(_acceptedStates), acceptedAtEnd(_acceptedAtEnd),
+          stateCount(_stateCount), charCategories(_charCategories), startState(_startState), beginState(_beginState),
+          anchoredAtBegin(_anchoredAtBegin) {}
+
+    constexpr int32_t getStartState() const {
+        return startState;
+    }
+    constexpr int32_t getBeginState() const {
+        return beginState;
+    }
+    constexpr bool isAccepted(int32_t state) const {
+        return acceptedStates[state] != 0;
+    }
+    constexpr bool isAcceptedAtEnd(int32_t state) const {
+        return acceptedAtEnd[state] != 0;
+    }
+    constexpr int32_t transit(int32_t state, unsigned char c) const {
+        return transitionTable[state * charCategories + charMap[c]];
+    }
+
+    bool searchHead(const char *input, Result *result=nullptr, uint32_t offset=0) const {
+        if (offset > strlen(input))
+            return false;
+        input += offset;
+        int32_t currentState = offset ? startState : beginState;
+        int32_t acceptedState = InvalidState;
+        int32_t length = -1;
+        const char *reading = input;
+        while (currentState != InvalidState) {
+            if (!*reading) {
+                if (acceptedAtEnd[currentState]) {
+                    acceptedState = currentState;
+                    length = reading - input;
+                }
+                break;
+            }
+            if (acceptedStates[currentState]) {
+                acceptedState = currentState;
+                length = reading - input;
+            }
+            currentState = transit(currentState, *reading++);
+        }
+        if (result) {
+            result->start = offset;
+            result->length = length;
+            result->terminateState = currentState;
+            result->acceptedState = acceptedState;
+        }
+        return acceptedState != InvalidState;
+    }
+
+    bool match(const char *input) const {
+        Result result;
+        return searchHead(input, &result, 0) && result.length == static_cast<int32_t>(strlen(input));
+    }
+
+    bool search(const char *input, Result *result=nullptr, uint32_t offset=0) const {
+        size_t length = strlen(input);
+        if (offset > length)
+            return false;
+        do {
+            if (searchHead(input, result, offset++))
+                return true;
+        } while (offset < length && !anchoredAtBegin);
+        return false;
+    }
+};
+#endif
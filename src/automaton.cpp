@@ -11,6 +11,8 @@ struct Transition::Hash : std::hash<Ptr> {
         switch (ptr->type) {
             case Transition::Chars:
                 return std::hash<uint32_t>()(((size_t)ptr->range.begin<<8) | ptr->range.end);
+            case Transition::Tag:
+                return std::hash<int32_t>()(ptr->tag) ^ ptr->type;
             default:
                 return std::hash<int>()(ptr->type);
         }
@@ -20,6 +22,8 @@ struct Transition::EqualTo : std::equal_to<Ptr> {
     bool operator() (Transition::Ptr lhs, Transition::Ptr rhs) const {
         if (lhs->type != rhs->type)
             return false;
+        if (lhs->type == Transition::Tag)
+            return lhs->tag == rhs->tag;
         return lhs->type != Transition::Chars || lhs->range == rhs->range;
     }
 };
@@ -73,6 +77,13 @@ Transition::Ptr Automaton::getNop(State::Ptr from, State::Ptr to) {
     return n;
 }
 
+Transition::Ptr Automaton::getTag(State::Ptr from, State::Ptr to, int32_t tag) {
+    auto t = getTransition(from, to);
+    t->type = Transition::Tag;
+    t->tag = tag;
+    return t;
+}
+
 static std::string escape(std::string input) {
     if (input == "\"")
         return "#quot;";
@@ -107,6 +118,9 @@ std::ostream & Automaton::toMermaid(std::ostream &os) {
                 case Transition::Nop:
                     os << "nop";
                     break;
+                case Transition::Tag:
+                    os << "t" << trans->tag;
+                    break;
                 default:
                     assertm(0, "Unkonwn Transition Type: %d", trans->type);
             }
@@ -122,8 +136,9 @@ std::ostream & Automaton::toMermaid(std::ostream &os) {
 void Automaton::reverse() {
     // 1. save the start state
     auto saved = startState;
-    // 2. reset the startState
+    // 2. reset the startState; a begin context does not survive reversal
     startState = getState();
+    beginState = nullptr;
     // 3. reverse all the transitions;
     for (auto &transition : transitions)
         swap(transition->source, transition->target);
@@ -147,6 +162,8 @@ void Automaton::reachableTrim() {
     std::queue<State::Ptr> statesQ;
     statesQ.push(startState);
     reachableStates.insert(startState);
+    if (beginState && reachableStates.insert(beginState).second)
+        statesQ.push(beginState);
     while (!statesQ.empty()) {
         auto cur = statesQ.front();
         statesQ.pop();
@@ -164,10 +181,21 @@ void Automaton::reachableTrim() {
     transitions.swap(usefulTransitions);
 }
 
+bool Automaton::hasAnchors() const {
+    if (beginState && beginState != startState)
+        return true;
+    for (auto transition : transitions) {
+        if (transition->type == Transition::BeginString || transition->type == Transition::EndString)
+            return true;
+    }
+    return false;
+}
+
 bool poorEpsilonChecker(Transition::Ptr transition) {
     switch (transition->type) {
         case Transition::Epsilon:
         case Transition::Nop:
+        case Transition::Tag:
             return true;
         default:
             return false;
@@ -177,22 +205,40 @@ bool poorEpsilonChecker(Transition::Ptr transition) {
 bool richEpsilonChecker(Transition::Ptr transition) {
     switch (transition->type) {
         case Transition::Epsilon:
+        case Transition::Tag:
             return true;
         default:
             return false;
     }
 }
 
-bool epsilonClosure(typename State::Ptr nfaState, bool (*epsilonChecker)(Transition::Ptr), State::List &epsilonStates, State::Set &epsilonSet, Transition::Map<State::List> &transitions, Transition::List &precedence) {
+// what the poor interpreter may follow before reading the first byte of the text
+bool poorBeginChecker(Transition::Ptr transition) {
+    return transition->type == Transition::BeginString || poorEpsilonChecker(transition);
+}
+
+/**
+ *  Visits in the order of the outbound transitions, which is the priority
+ *  order of the NFA. Given cut, the visit stops at the first accepting
+ *  state and sets *cut: under leftmost-first semantics whatever comes after
+ *  it can only yield less preferred matches.
+**/
+bool epsilonClosure(typename State::Ptr nfaState, bool (*epsilonChecker)(Transition::Ptr), State::List &epsilonStates, State::Set &epsilonSet, Transition::Map<State::List> &transitions, Transition::List &precedence, bool *cut=nullptr) {
     bool isAccepted = nfaState->isAccepted;
     if (epsilonSet.find(nfaState) == epsilonSet.end()) {
         if (epsilonSet.emplace(nfaState).second)
             epsilonStates.emplace_back(nfaState);
+        if (cut && isAccepted) {
+            *cut = true;
+            return true;
+        }
         for (auto trans : nfaState->outbounds) {
             if (epsilonChecker(trans)) {
                 if (trans->target->isAccepted)
                     isAccepted = true;
-                isAccepted |= epsilonClosure(trans->target, epsilonChecker, epsilonStates, epsilonSet, transitions, precedence);
+                isAccepted |= epsilonClosure(trans->target, epsilonChecker, epsilonStates, epsilonSet, transitions, precedence, cut);
+                if (cut && *cut)
+                    break;
             } else {
                 if (transitions[trans].empty())
                     precedence.emplace_back(trans);
@@ -203,7 +249,18 @@ bool epsilonClosure(typename State::Ptr nfaState, bool (*epsilonChecker)(Transit
     return isAccepted;
 }
 
-Automaton::Ptr powerset(Automaton::Ptr nfa, bool (*epsilonChecker)(Transition::Ptr), std::map<State::List, State::Ptr> &stateMap) {
+/**
+ *  With a nonzero stateLimit, gives up and returns nullptr once the DFA would
+ *  outgrow it. With a beginChecker, BeginString is only satisfiable before
+ *  the first byte: the closure of the NFA start state under beginChecker
+ *  becomes the DFA's beginState, and BeginString transitions elsewhere are
+ *  dropped instead of becoming symbols. With leftmostFirst, each subset is
+ *  cut after its first accepting NFA state (see epsilonClosure), so that
+ *  scanning for the longest accepted prefix yields the match a
+ *  backtracking engine prefers, and stops as soon as no preferred one is
+ *  left.
+**/
+Automaton::Ptr powerset(Automaton::Ptr nfa, bool (*epsilonChecker)(Transition::Ptr), std::map<State::List, State::Ptr> &stateMap, size_t stateLimit, bool (*beginChecker)(Transition::Ptr), bool leftmostFirst) {
     Automaton::Ptr dfa(new Automaton);
     //std::map<State::List, State::Ptr> stateMap;
     std::queue<State::List> statesQ;
@@ -214,14 +271,33 @@ Automaton::Ptr powerset(Automaton::Ptr nfa, bool (*epsilonChecker)(Transition::P
     Transition::Map<State::List> transitions;
     Transition::List precedence;
     bool isAccepted = false;
+    bool cut = false;
+    bool *cutter = leftmostFirst ? &cut : nullptr;
 
     dfa->startState = dfa->getState();
-    isAccepted = epsilonClosure(nfa->startState, epsilonChecker, epsilonStates, epsilonSet, transitions, precedence);
+    isAccepted = epsilonClosure(nfa->startState, epsilonChecker, epsilonStates, epsilonSet, transitions, precedence, cutter);
     dfa->startState->isAccepted = isAccepted;
     statesQ.push(epsilonStates);
     transitionsQ.push(transitions);
     precedenceQ.push(precedence);
     stateMap.emplace(epsilonStates, dfa->startState);
+    dfa->beginState = dfa->startState;
+    if (beginChecker) {
+        epsilonStates.clear();
+        transitions.clear();
+        precedence.clear();
+        epsilonSet.clear();
+        cut = false;
+        isAccepted = epsilonClosure(nfa->startState, beginChecker, epsilonStates, epsilonSet, transitions, precedence, cutter);
+        if (stateMap.find(epsilonStates) == stateMap.end()) {
+            dfa->beginState = dfa->getState();
+            dfa->beginState->isAccepted = isAccepted;
+            stateMap.emplace(epsilonStates, dfa->beginState);
+            statesQ.push(epsilonStates);
+            transitionsQ.push(transitions);
+            precedenceQ.push(precedence);
+        }
+    }
 
     while (!statesQ.empty()) {
         State::List curStates = statesQ.front();
@@ -231,14 +307,22 @@ Automaton::Ptr powerset(Automaton::Ptr nfa, bool (*epsilonChecker)(Transition::P
         Transition::List curPrecedence = precedenceQ.front();
         precedenceQ.pop();
         for (auto t : curPrecedence) {
+            if (beginChecker && t->type == Transition::BeginString)
+                continue;
             epsilonStates.clear();
             transitions.clear();
             precedence.clear();
             epsilonSet.clear();
             isAccepted = false;
-            for (auto s : curTransitions[t])
-                isAccepted |= epsilonClosure(s, epsilonChecker, epsilonStates, epsilonSet, transitions, precedence);
+            cut = false;
+            for (auto s : curTransitions[t]) {
+                isAccepted |= epsilonClosure(s, epsilonChecker, epsilonStates, epsilonSet, transitions, precedence, cutter);
+                if (cut)
+                    break;
+            }
             if (stateMap.find(epsilonStates) == stateMap.end()) {
+                if (stateLimit && dfa->states.size() == stateLimit)
+                    return nullptr;
                 State::Ptr dfaState = dfa->getState();
                 dfaState->isAccepted = isAccepted;
                 stateMap.emplace(epsilonStates, dfaState);
@@ -254,77 +338,113 @@ Automaton::Ptr powerset(Automaton::Ptr nfa, bool (*epsilonChecker)(Transition::P
     return dfa;
 }
 
-std::vector<State::Set> split(State::Set states, const std::set<State::Set> &partition) {
-    std::vector<State::Set> ret(1);
-    Transition::Map<std::set<State::Set>::iterator> dict;
-    auto i = states.begin(), iend = states.end();
-    for (auto transition : (*i)->outbounds) {
-        for (auto j = partition.cbegin(), jend = partition.cend(); j != jend; ++j) {
-            if (j->find(transition->target) != j->end()) {
-                dict.emplace(transition, j);
-                break;
-            }
+/**
+ *  Hopcroft's partition refinement over the DFA completed by an implicit
+ *  dead state. Each round splits every block by the predecessors of one
+ *  splitter on one symbol, and only the smaller half of a split block goes
+ *  back to the worklist, so a chain such as x{1,1000} no longer takes as
+ *  many passes over all states as it is long.
+**/
+Automaton::Ptr Hopcroft(Automaton::Ptr dfa, std::map<State::Ptr, State::Ptr> &stateMap) {
+    std::vector<State::Ptr> states(dfa->states.begin(), dfa->states.end());
+    std::unordered_map<State *, int32_t> ids;
+    for (size_t i = 0; i < states.size(); ++i)
+        ids.emplace(states[i].get(), i);
+    const int32_t dead = states.size(), count = dead + 1;
+
+    // the unified ranges of a DFA are equal or disjoint, so each is a symbol
+    std::map<uint32_t, int32_t> symbols;
+    std::vector<std::vector<int32_t>> delta;
+    for (int32_t i = 0; i < dead; ++i) {
+        for (auto &transition : states[i]->outbounds) {
+            uint32_t key = (transition->type << 16) | (transition->range.begin << 8) | transition->range.end;
+            int32_t symbol = symbols.emplace(key, symbols.size()).first->second;
+            if (symbol == static_cast<int32_t>(delta.size()))
+                delta.emplace_back(count, dead);
+            delta[symbol][i] = ids[transition->target.get()];
         }
     }
-    ret[0].emplace(*i);
-    for (++i; i != iend; ++i) {
-        size_t index = 0;
-        if ((*i)->outbounds.size() == dict.size()) {
-            for (auto transition : (*i)->outbounds) {
-                if (dict.find(transition) == dict.end() || dict[transition]->find(transition->target) == dict[transition]->end()) {
-                    index = 1;
-                    break;
-                }
-            }
-        } else
-            index = 1;
-        if (index == ret.size())
-            ret.resize(2);
-        ret[index].emplace(*i);
+    const int32_t symbolCount = delta.size();
+    std::vector<std::vector<std::vector<int32_t>>> inverse(symbolCount, std::vector<std::vector<int32_t>>(count));
+    for (int32_t symbol = 0; symbol < symbolCount; ++symbol) {
+        for (int32_t i = 0; i < count; ++i)
+            inverse[symbol][delta[symbol][i]].push_back(i);
     }
-    return ret;
-}
 
-Automaton::Ptr Hopcroft(Automaton::Ptr dfa, std::map<State::Ptr, State::Ptr> &stateMap) {
-    State::Set acceptedStates, nonacceptedStates;
-    for (auto state : dfa->states) {
-        if (state->isAccepted)
-            acceptedStates.emplace(state);
-        else
-            nonacceptedStates.emplace(state);
+    std::vector<int32_t> blockOf(count);
+    std::vector<std::vector<int32_t>> blocks(2);
+    for (int32_t i = 0; i < count; ++i) {
+        blockOf[i] = i != dead && states[i]->isAccepted ? 0 : 1;
+        blocks[blockOf[i]].push_back(i);
+    }
+    if (blocks[0].empty()) {
+        blocks.erase(blocks.begin());
+        std::fill(blockOf.begin(), blockOf.end(), 0);
+    }
+    std::vector<std::pair<int32_t, int32_t>> pending;
+    std::vector<std::vector<char>> queued(blocks.size(), std::vector<char>(symbolCount, false));
+    auto enqueue = [&](int32_t block, int32_t symbol) {
+        if (!queued[block][symbol]) {
+            queued[block][symbol] = true;
+            pending.emplace_back(block, symbol);
+        }
+    };
+    if (blocks.size() == 2) {
+        for (int32_t symbol = 0; symbol < symbolCount; ++symbol)
+            enqueue(blocks[0].size() <= blocks[1].size() ? 0 : 1, symbol);
     }
-    std::set<State::Set> partitions, saved;
-    partitions.emplace(acceptedStates);
-    if (!nonacceptedStates.empty())
-        partitions.emplace(nonacceptedStates);
-    while (partitions != saved) {
-        std::swap(partitions, saved);
-        partitions.clear();
-        for (auto states : saved) {
-            if (states.size() < 2)
-                partitions.emplace(states);
-            else {
-                auto sets = split(states, saved);
-                partitions.insert(sets.begin(), sets.end());
+    std::map<int32_t, std::vector<int32_t>> touched;
+    while (!pending.empty()) {
+        int32_t splitter = pending.back().first, symbol = pending.back().second;
+        pending.pop_back();
+        queued[splitter][symbol] = false;
+        touched.clear();
+        for (int32_t target : blocks[splitter]) {
+            for (int32_t source : inverse[symbol][target])
+                touched[blockOf[source]].push_back(source);
+        }
+        for (auto &entry : touched) {
+            int32_t block = entry.first, split = blocks.size();
+            if (entry.second.size() == blocks[block].size())
+                continue;
+            for (int32_t state : entry.second)
+                blockOf[state] = split;
+            blocks.push_back(entry.second);
+            queued.emplace_back(symbolCount, false);
+            auto &rest = blocks[block];
+            rest.erase(std::remove_if(rest.begin(), rest.end(), [&](int32_t state) { return blockOf[state] != block; }), rest.end());
+            for (int32_t c = 0; c < symbolCount; ++c) {
+                if (queued[block][c])
+                    enqueue(split, c);
+                else
+                    enqueue(blocks[block].size() <= blocks[split].size() ? block : split, c);
             }
         }
     }
 
     Automaton::Ptr mdfa = Automaton::Ptr(new Automaton);
-    //std::map<State::Ptr, State::Ptr> stateMap;
-    for (auto &states : partitions) {
-        auto mdfaState = mdfa->getState();
-        for (auto &dfaState : states) {
-            if (dfaState->isAccepted)
+    std::vector<State::Ptr> mstates(blocks.size());
+    for (size_t block = 0; block < blocks.size(); ++block) {
+        for (int32_t i : blocks[block]) {
+            if (i == dead)
+                continue;
+            if (!mstates[block])
+                mstates[block] = mdfa->getState();
+            auto &mdfaState = mstates[block];
+            if (states[i]->isAccepted)
                 mdfaState->isAccepted = true;
-            if (dfaState == dfa->startState)
+            if (states[i] == dfa->startState)
                 mdfa->startState = mdfaState;
-            stateMap.emplace(dfaState, mdfaState);
+            if (states[i] == dfa->beginState)
+                mdfa->beginState = mdfaState;
+            stateMap.emplace(states[i], mdfaState);
         }
     }
-    for (auto &states : partitions) {
-        auto dfaState = *states.begin();
-        for (auto transition : dfaState->outbounds) {
+    for (size_t block = 0; block < blocks.size(); ++block) {
+        auto representative = blocks[block].front() != dead ? blocks[block].front() : blocks[block].back();
+        if (representative == dead)
+            continue;
+        for (auto transition : states[representative]->outbounds) {
             auto nTransit = mdfa->getTransition(stateMap[transition->source], stateMap[transition->target]);
             nTransit->type = transition->type;
             nTransit->range = transition->range;
@@ -333,17 +453,47 @@ Automaton::Ptr Hopcroft(Automaton::Ptr dfa, std::map<State::Ptr, State::Ptr> &st
     return mdfa;
 }
 
-// Automaton::Ptr Brzozowski(Automaton::Ptr nfa, bool (*epsilonChecker)(Transition::Ptr)) {
-//     nfa->reverse();
-//     auto tdfa = powerset(nfa, epsilonChecker);
-//     tdfa->reachableTrim();
-//     tdfa->reverse();
-//     auto mdfa = powerset(tdfa, epsilonChecker);
-//     mdfa->toMermaid(std::cout) << std::endl;
-//     mdfa->reachableTrim();
-//     mdfa->toMermaid(std::cout) << std::endl;
-//     return mdfa;
-// }
+/**
+ *  Minimizes by determinizing twice, each time after reversal: the subset
+ *  construction of the reverse of an accessible DFA is minimal. Consumes
+ *  nfa, which is left reversed.
+**/
+Automaton::Ptr Brzozowski(Automaton::Ptr nfa, bool (*epsilonChecker)(Transition::Ptr)) {
+    std::map<State::List, State::Ptr> stateMap;
+    nfa->reverse();
+    auto tdfa = powerset(nfa, epsilonChecker, stateMap);
+    tdfa->reachableTrim();
+    tdfa->reverse();
+    stateMap.clear();
+    auto dfa = powerset(tdfa, epsilonChecker, stateMap);
+    // powerset keys its states by ordered lists, and the start state of the
+    // reversal is only an epsilon hub, yet minimality holds for the plain
+    // subsets of tdfa's states: merge the states that hold the same one
+    std::map<State::Set, State::Ptr> subsets;
+    std::map<State::Ptr, State::Ptr> representatives;
+    for (auto &entry : stateMap) {
+        State::Set subset(entry.first.begin(), entry.first.end());
+        subset.erase(tdfa->startState);
+        representatives[entry.second] = subsets.emplace(subset, entry.second).first->second;
+    }
+    Automaton::Ptr mdfa(new Automaton);
+    std::map<State::Ptr, State::Ptr> mstates;
+    for (auto &subset : subsets) {
+        auto state = mdfa->getState();
+        state->isAccepted = subset.second->isAccepted;
+        mstates.emplace(subset.second, state);
+    }
+    mdfa->startState = mstates[representatives[dfa->startState]];
+    for (auto &subset : subsets) {
+        for (auto transition : subset.second->outbounds) {
+            auto mtransition = mdfa->getTransition(mstates[subset.second], mstates[representatives[transition->target]]);
+            mtransition->type = transition->type;
+            mtransition->range = transition->range;
+        }
+    }
+    mdfa->reachableTrim();
+    return mdfa;
+}
 
 void print(Automaton::Ptr automaton) {
     for (auto state : automaton->states) {
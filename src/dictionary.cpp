@@ -0,0 +1,124 @@
+#include <algorithm>
+#include <queue>
+#include "dictionary.h"
+#include "utility.h"
+
+DictionaryBuilder::DictionaryBuilder() {
+    path.emplace_back(getNode());
+}
+
+int32_t DictionaryBuilder::getNode() {
+    int32_t index;
+    if (freeNodes.empty()) {
+        index = nodes.size();
+        nodes.emplace_back();
+    } else {
+        index = freeNodes.back();
+        freeNodes.pop_back();
+        nodes[index].edges.clear();
+    }
+    nodes[index].isAccepted = false;
+    nodes[index].parents = 0;
+    return index;
+}
+
+// Merge every state of the previous word deeper than depth with its registered equivalent
+void DictionaryBuilder::replaceOrRegister(size_t depth) {
+    while (path.size() > depth + 1) {
+        int32_t child = path.back();
+        path.pop_back();
+        Signature signature(nodes[child].isAccepted, nodes[child].edges);
+        auto registered = registry.find(signature);
+        if (registered != registry.end()) {
+            nodes[path.back()].edges.back().second = registered->second;
+            ++nodes[registered->second].parents;
+            for (auto &edge : nodes[child].edges)
+                --nodes[edge.second].parents;
+            freeNodes.emplace_back(child);
+        } else
+            registry.emplace(std::move(signature), child);
+    }
+}
+
+/**
+ *  build() registers the path of the previous word too. Before it grows
+ *  again, its states down to depth leave the registry; those other words
+ *  lead to as well are copied instead.
+**/
+void DictionaryBuilder::unregisterPath(size_t depth) {
+    while (path.size() <= depth) {
+        int32_t child = nodes[path.back()].edges.back().second;
+        if (nodes[child].parents == 1) {
+            registry.erase(Signature(nodes[child].isAccepted, nodes[child].edges));
+        } else {
+            int32_t copy = getNode();
+            nodes[copy].edges = nodes[child].edges;
+            nodes[copy].isAccepted = nodes[child].isAccepted;
+            for (auto &grandchild : nodes[copy].edges)
+                ++nodes[grandchild.second].parents;
+            --nodes[child].parents;
+            child = copy;
+        }
+        nodes[path.back()].edges.back().second = child;
+        nodes[child].parents = 1;
+        path.emplace_back(child);
+    }
+}
+
+void DictionaryBuilder::insert(const std::string &word) {
+    assertm(previous <= word, "DictionaryBuilder::insert() expects words in lexicographic order\n");
+    size_t common = 0;
+    while (common < previous.size() && common < word.size() && previous[common] == word[common])
+        ++common;
+    unregisterPath(common);
+    if (common == word.size() && common == previous.size() && nodes[path.back()].isAccepted)
+        return;
+    replaceOrRegister(common);
+    for (size_t i = common, iend = word.size(); i != iend; ++i) {
+        int32_t next = getNode();
+        nodes[path.back()].edges.emplace_back(word[i], next);
+        nodes[next].parents = 1;
+        path.emplace_back(next);
+    }
+    nodes[path.back()].isAccepted = true;
+    previous = word;
+}
+
+Automaton::Ptr DictionaryBuilder::build() {
+    replaceOrRegister(0);
+    Automaton::Ptr dfa(new Automaton);
+    std::vector<State::Ptr> states(nodes.size());
+    std::queue<int32_t> nodesQ;
+    states[path[0]] = dfa->startState = dfa->getState();
+    nodesQ.push(path[0]);
+    while (!nodesQ.empty()) {
+        int32_t cur = nodesQ.front();
+        nodesQ.pop();
+        states[cur]->isAccepted = nodes[cur].isAccepted;
+        auto &edges = nodes[cur].edges;
+        for (size_t i = 0, iend = edges.size(), j; i != iend; i = j) {
+            int32_t target = edges[i].second;
+            if (!states[target]) {
+                states[target] = dfa->getState();
+                nodesQ.push(target);
+            }
+            // consecutive characters leading to the same state share one transition
+            for (j = i + 1; j != iend && edges[j].second == target && edges[j].first == edges[j-1].first + 1; ++j)
+                ;
+            dfa->getChars(states[cur], states[target], Range<unsigned char>(edges[i].first, edges[j-1].first));
+        }
+    }
+    return dfa;
+}
+
+size_t DictionaryBuilder::size() const {
+    return nodes.size() - freeNodes.size();
+}
+
+Automaton::Ptr buildDictionary(std::vector<std::string> words) {
+    std::sort(words.begin(), words.end());
+    DictionaryBuilder builder;
+    for (auto &word : words)
+        builder.insert(word);
+    return builder.build();
+}
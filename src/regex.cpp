@@ -4,6 +4,38 @@
 #include "automaton.h"
 #include "regex_expression.h"
 #include "regex_interpreter.h"
+#include "regex_compiler.h"
+#include "regex_codegen.h"
+
+// toy-yacc --cpp|--tables file.re [name]: the pattern in file.re as a generated header on stdout
+int generate(int argc, char *argv[])
+{
+    std::ifstream ifs(argv[2]);
+    if (!ifs) {
+        std::cerr << "cannot open " << argv[2] << std::endl;
+        return -1;
+    }
+    std::string pattern((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+    while (!pattern.empty() && (pattern.back() == '\n' || pattern.back() == '\r'))
+        pattern.pop_back();
+    std::string name;
+    if (argc > 3) {
+        name = argv[3];
+    } else {
+        name = argv[2];
+        name = name.substr(name.find_last_of('/') + 1);
+        name = name.substr(0, name.find('.'));
+    }
+    auto dfa = compileDfa(pattern);
+    if (std::string(argv[1]) == "--tables") {
+        generateTables(PoorInterpreter(dfa), name, std::cout);
+    } else if (dfa->hasAnchors()) {
+        std::cerr << "--cpp does not support ^ and $, use --tables" << std::endl;
+        return -1;
+    } else
+        generateCpp(PoorInterpreter(dfa), name, std::cout);
+    return 0;
+}
 
 int main(int argc, char *argv[])
 {
@@ -13,8 +45,18 @@ int main(int argc, char *argv[])
     // const char *input = "[aaa]";
     if (argc < 2) {
         std::cout << "Usage: " << argv[0] << " pattern [match] ..." << std::endl;
+        std::cout << "       " << argv[0] << " --cpp|--tables file.re [name]" << std::endl;
         return -1;
     }
+    if (std::string(argv[1]) == "--cpp" || std::string(argv[1]) == "--tables") {
+        if (argc < 3) {
+            std::cout << "Usage: " << argv[0] << " " << argv[1] << " file.re [name]" << std::endl;
+            return -1;
+        }
+        return generate(argc, argv);
+    }
+    ExpressionArena arena;
+    ExpressionArena::Scope scope(arena);
     auto regex = parseRegex(argv[1]);
     std::ofstream ofs("r.dot");
     regex->graphviz(ofs);
@@ -22,6 +64,7 @@ int main(int argc, char *argv[])
     Range<unsigned char>::List unifiedRanges;
     regex->setNormalize(&unifiedRanges);
     regex->setUnify(unifiedRanges);
+    regex = factorize(regex);
     auto automaton = regex->generateEpsilonNfa();
     automaton->toMermaid(std::cout) << std::endl;
     std::map<State::List, State::Ptr> nfaStateMap;
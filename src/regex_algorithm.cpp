@@ -1,91 +1,119 @@
-#include <sstream>
+#include <algorithm>
+#include <ostream>
+#include <utility>
 #include "regex_algorithm.h"
 #include "utility.h"
 
 
+// pairs of children are only put off here; false when just one of them is
+// empty or they differ in kind
+bool EqualsVisitor::same(Expression::Ptr expression, Expression *target) {
+    if (expression == target)
+        return true;
+    if (!expression || !target || expression->kind != target->kind)
+        return false;
+    pending.emplace_back(expression, target);
+    return true;
+}
+
+bool EqualsVisitor::equals(Expression *expression, Expression *target) {
+    size_t base = pending.size();
+    bool equal = same(expression, target);
+    while (equal && pending.size() > base) {
+        auto next = pending.back();
+        pending.pop_back();
+        equal = invoke(next.first, next.second);
+    }
+    pending.resize(base);
+    return equal;
+}
+
 bool EqualsVisitor::visit(CharRangeExpression *expression, Expression *target) {
-    CharRangeExpression *that = dynamic_cast<CharRangeExpression *>(target);
+    CharRangeExpression *that = expressionCast<CharRangeExpression>(target);
     if (!that)
         return false;
     return expression->range == that->range;
 }
 
-bool EqualsVisitor::visit(BeginExpression *expression, Expression *target) {
-    return dynamic_cast<BeginExpression *>(target);
+bool EqualsVisitor::visit(BeginExpression *, Expression *target) {
+    return expressionCast<BeginExpression>(target);
 }
 
-bool EqualsVisitor::visit(EndExpression *expression, Expression *target) {
-    return dynamic_cast<EndExpression *>(target);
+bool EqualsVisitor::visit(EndExpression *, Expression *target) {
+    return expressionCast<EndExpression>(target);
 }
 
 bool EqualsVisitor::visit(RepeatExpression *expression, Expression *target) {
-    RepeatExpression *that = dynamic_cast<RepeatExpression *>(target);
+    RepeatExpression *that = expressionCast<RepeatExpression>(target);
     if (!that)
         return false;
-    if (expression->times != expression->times || expression->isGreedy != that->isGreedy)
+    if (expression->times != that->times || expression->isGreedy != that->isGreedy)
         return false;
-    return invoke(expression->expression, that->expression.get());
+    return same(expression->expression, that->expression);
 }
 
 bool EqualsVisitor::visit(SetExpression *expression, Expression *target) {
-    SetExpression *that = dynamic_cast<SetExpression *>(target);
+    SetExpression *that = expressionCast<SetExpression>(target);
     if (!that)
         return false;
     if (expression->isComplementary != that->isComplementary)
         return false;
     // if (!expression->expression ^ !that->expression)
     //     return false;
-    if (!expression->expression && !that->expression)
-        return true;
-    if (expression->expression && that->expression)
-        return invoke(expression->expression, that->expression.get());
-    return false;
+    return same(expression->expression, that->expression);
 }
 
 bool EqualsVisitor::visit(ConcatenationExpression *expression, Expression *target) {
-    ConcatenationExpression *that = dynamic_cast<ConcatenationExpression *>(target);
-    if (!that)
+    ConcatenationExpression *that = expressionCast<ConcatenationExpression>(target);
+    if (!that || expression->items.size() != that->items.size())
         return false;
-    return invoke(expression->left, that->left.get()) && invoke(expression->right, that->right.get());
+    for (size_t i = 0, iend = expression->items.size(); i != iend; ++i) {
+        if (!same(expression->items[i], that->items[i]))
+            return false;
+    }
+    return true;
 }
 
 bool EqualsVisitor::visit(SelectExpression *expression, Expression *target) {
-    SelectExpression *that = dynamic_cast<SelectExpression *>(target);
-    if (!that)
+    SelectExpression *that = expressionCast<SelectExpression>(target);
+    if (!that || expression->items.size() != that->items.size())
+        return false;
+    for (size_t i = 0, iend = expression->items.size(); i != iend; ++i) {
+        if (!same(expression->items[i], that->items[i]))
+            return false;
+    }
+    return true;
+}
+
+bool EqualsVisitor::visit(GroupExpression *expression, Expression *target) {
+    GroupExpression *that = expressionCast<GroupExpression>(target);
+    if (!that || expression->index != that->index)
         return false;
-    return invoke(expression->left, that->left.get()) && invoke(expression->right, that->right.get());
+    return same(expression->expression, that->expression);
 }
 
 GraphvizVisitor::GraphvizVisitor(std::ostream &os, unsigned long x) : dot(os), id(x) { }
 
 std::string GraphvizVisitor::visit(CharRangeExpression *expression, void *) {
-    std::ostringstream os;
-    os << "CharRange_" << id++;
-    std::string name = os.str();
+    std::string name = "CharRange_" + std::to_string(id++);
     dot << name << " [ label=\"" << repr(expression->range.begin) << "-" << repr(expression->range.end) << "\" ]" << "\n";
     return name;
 }
 
-std::string GraphvizVisitor::visit(BeginExpression *expression, void *) {
-    std::ostringstream os;
-    os << "Begin_" << id++;
-    std::string name = os.str();
+std::string GraphvizVisitor::visit(BeginExpression *, void *) {
+    std::string name = "Begin_" + std::to_string(id++);
     dot << name << " [ label=\"BEGIN\" ]" << "\n";
     return name;
 }
 
-std::string GraphvizVisitor::visit(EndExpression *expression, void *) {
-    std::ostringstream os;
-    os << "End_" << id++;
-    std::string name = os.str();
+std::string GraphvizVisitor::visit(EndExpression *, void *) {
+    std::string name = "End_" + std::to_string(id++);
     dot << name << " [ label=\"END\" ]" << "\n";
     return name;
 }
 
 std::string GraphvizVisitor::visit(RepeatExpression *expression, void *) {
-    std::ostringstream os;
-    os << "Repeat_" << id++;
-    std::string name = os.str(), target = invoke(expression->expression, nullptr);
+    std::string name = "Repeat_" + std::to_string(id++), target = invoke(expression->expression, nullptr);
     dot << name << "->" << target << '\n';
 
     dot << name << " [ label=\"";
@@ -101,9 +129,7 @@ std::string GraphvizVisitor::visit(RepeatExpression *expression, void *) {
 }
 
 std::string GraphvizVisitor::visit(SetExpression *expression, void *) {
-    std::ostringstream os;
-    os << "Set_" << id++;
-    std::string name = os.str();
+    std::string name = "Set_" + std::to_string(id++);
     if (expression->expression) {
         std::string target = invoke(expression->expression, nullptr);
         dot << name << "->" << target << '\n';
@@ -117,25 +143,37 @@ std::string GraphvizVisitor::visit(SetExpression *expression, void *) {
 }
 
 std::string GraphvizVisitor::visit(ConcatenationExpression *expression, void *) {
-    std::ostringstream os;
-    os << "Concatenation_" << id++;
-    std::string name = os.str();
-    std::string ltarget = invoke(expression->left, nullptr), rtarget = invoke(expression->right, nullptr);
-    dot << name << "->{" << ltarget << " " << rtarget << "}" << '\n';
+    std::string name = "Concatenation_" + std::to_string(id++);
+    std::string targets;
+    for (auto item : expression->items)
+        targets += " " + invoke(item, nullptr);
+    dot << name << "->{" << targets.substr(1) << "}" << '\n';
     dot << name << " [ label=\"Con\" ]" << "\n";
     return name;
 }
 
 std::string GraphvizVisitor::visit(SelectExpression *expression, void *) {
-    std::ostringstream os;
-    os << "Select_" << id++;
-    std::string name = os.str();
-    std::string ltarget = invoke(expression->left, dot), rtarget = invoke(expression->right, dot);
-    dot << name << "->{" << ltarget << " " << rtarget << "}" << '\n';
+    std::string name = "Select_" + std::to_string(id++);
+    std::string targets;
+    for (auto item : expression->items) {
+        if (item)
+            targets += " " + invoke(item, nullptr);
+    }
+    dot << name << "->{" << (targets.empty() ? targets : targets.substr(1)) << "}" << '\n';
     dot << name << " [ label=\"|\" ]" << "\n";
     return name;
 }
 
+std::string GraphvizVisitor::visit(GroupExpression *expression, void *) {
+    std::string name = "Group_" + std::to_string(id++);
+    if (expression->expression) {
+        std::string target = invoke(expression->expression, nullptr);
+        dot << name << "->" << target << '\n';
+    }
+    dot << name << " [ label=\"(" << expression->index << ")\" ]" << "\n";
+    return name;
+}
+
 std::string GraphvizVisitor::repr(unsigned char c) {
     std::string tmp = ::repr(c);
     if (tmp.size() == 2 && tmp != "\\\\")
@@ -145,69 +183,95 @@ std::string GraphvizVisitor::repr(unsigned char c) {
     return tmp;
 }
 
-Expression::Ptr SetNormalizationVisitor::rebuild(Expression::Ptr posit, unsigned char begin, unsigned char end) {
-    CharRangeExpression *range = new CharRangeExpression(begin, end);
-    if (posit) {
-        SelectExpression *select = new SelectExpression;
-        select->left = Expression::Ptr(range);
-        select->right = posit;
-        posit = Expression::Ptr(select);
-    } else
-        posit.reset(range);
-    return posit;
+void SetNormalizationVisitor::rebuild(std::vector<Expression::Ptr> &items, unsigned char begin, unsigned char end) {
+    items.emplace_back(new CharRangeExpression(begin, end));
+}
+
+void SetNormalizationVisitor::descend(Expression::Ptr &expression) {
+    pending.emplace_back(&expression);
+}
+
+void SetNormalizationVisitor::step(Expression::Ptr &expression, Range<unsigned char>::List *unifiedRanges) {
+    invoke(expression, unifiedRanges);
+}
+
+void SetNormalizationVisitor::normalize(Expression::Ptr expression, Range<unsigned char>::List *unifiedRanges) {
+    size_t base = pending.size();
+    invoke(expression, unifiedRanges);
+    while (pending.size() > base) {
+        Expression::Ptr *next = pending.back();
+        pending.pop_back();
+        step(*next, unifiedRanges);
+    }
 }
 
 void SetNormalizationVisitor::visit(CharRangeExpression *expression, Range<unsigned char>::List *unifiedRanges) {
     marshalRange(expression->range, *unifiedRanges);
 }
-void SetNormalizationVisitor::visit(BeginExpression *expression, Range<unsigned char>::List *) { }
-void SetNormalizationVisitor::visit(EndExpression *expression, Range<unsigned char>::List *) { }
-void SetNormalizationVisitor::visit(RepeatExpression *expression, Range<unsigned char>::List *unifiedRanges) {
-    invoke(expression->expression, unifiedRanges);
+void SetNormalizationVisitor::visit(BeginExpression *, Range<unsigned char>::List *) { }
+void SetNormalizationVisitor::visit(EndExpression *, Range<unsigned char>::List *) { }
+void SetNormalizationVisitor::visit(RepeatExpression *expression, Range<unsigned char>::List *) {
+    descend(expression->expression);
 }
-void SetNormalizationVisitor::visit(SetExpression *expression, Range<unsigned char>::List *unifiedRanges) {
+void SetNormalizationVisitor::visit(SetExpression *expression, Range<unsigned char>::List *) {
     if (!expression->expression)
         return;
     Range<unsigned char>::List ranges;
-    invoke(expression->expression, &ranges);
+    normalize(expression->expression, &ranges);
+    std::vector<Expression::Ptr> items;
     if (expression->isComplementary) {
         unsigned char end = '\xff';
-        Expression::Ptr posit;
         for (auto i = ranges.rbegin(), iend = ranges.rend(); i != iend; ++i) {
             if (end > i->end) {
-                posit = rebuild(posit, i->end+1, end);
+                rebuild(items, i->end+1, end);
             }
             end = i->begin - 1;
             if (i->begin == '\x01')
                 break;
         }
         if (end != '\x00')
-            posit = rebuild(posit, '\x01', end);
-
+            rebuild(items, '\x01', end);
         expression->isComplementary = false;
-        expression->expression = posit;
     } else {
-        Expression::Ptr posit;
         unsigned char begin = ranges.rbegin()->end+1, end = ranges.rbegin()->end;
         for (auto i = ranges.rbegin(), iend = ranges.rend(); i != iend; ++i) {
             if (begin-1 != i->end) {
-                posit = rebuild(posit, begin, end);
+                rebuild(items, begin, end);
                 end = i->end;
             }
             begin = i->begin;
         }
-        posit = rebuild(posit, begin, end);
-        expression->expression = posit;
+        rebuild(items, begin, end);
     }
-    invoke(expression->expression, unifiedRanges);
+    std::reverse(items.begin(), items.end());
+    expression->expression = alternate(items);
+    descend(expression->expression);
 }
-void SetNormalizationVisitor::visit(ConcatenationExpression *expression, Range<unsigned char>::List *unifiedRanges) {
-    invoke(expression->left, unifiedRanges);
-    invoke(expression->right, unifiedRanges);
+void SetNormalizationVisitor::visit(ConcatenationExpression *expression, Range<unsigned char>::List *) {
+    for (size_t i = expression->items.size(); i--; )
+        descend(expression->items[i]);
 }
-void SetNormalizationVisitor::visit(SelectExpression *expression, Range<unsigned char>::List *unifiedRanges) {
-    invoke(expression->left, unifiedRanges);
-    invoke(expression->right, unifiedRanges);
+void SetNormalizationVisitor::visit(SelectExpression *expression, Range<unsigned char>::List *) {
+    for (size_t i = expression->items.size(); i--; ) {
+        if (expression->items[i])
+            descend(expression->items[i]);
+    }
+}
+void SetNormalizationVisitor::visit(GroupExpression *expression, Range<unsigned char>::List *) {
+    if (expression->expression)
+        descend(expression->expression);
+}
+
+// a bare range such as <any> is split like a set, or it would overlap the others
+void SetUnificationVisitor::step(Expression::Ptr &expression, Range<unsigned char>::List *unifiedRanges) {
+    CharRangeExpression *range = expressionCast<CharRangeExpression>(expression);
+    if (range && range->range.begin != range->range.end) {
+        SetExpression *set = new SetExpression;
+        set->isComplementary = false;
+        set->expression = expression;
+        expression = set;
+    }
+    invoke(expression, unifiedRanges);
 }
 
 void SetUnificationVisitor::visit(SetExpression *expression, Range<unsigned char>::List *unifiedRanges) {
@@ -215,15 +279,36 @@ void SetUnificationVisitor::visit(SetExpression *expression, Range<unsigned char
         return;
     assertm(!expression->isComplementary, "Unable to apply SetUnificationVisitor to negative SetExpression.\nPlease class setNormalize() first.");
     Range<unsigned char>::List ranges;
-    invoke(expression->expression, &ranges);
-    Expression::Ptr posit;
+    SetNormalizationVisitor().normalize(expression->expression, &ranges);
+    std::vector<Expression::Ptr> items;
     for (auto i = ranges.rbegin(), iend = ranges.rend(); i != iend; ++i) {
         for (auto j = unifiedRanges->rbegin(), jend = unifiedRanges->rend(); j != jend; ++j) {
             if (i->begin <= j->begin && j->end <= i->end)
-                posit = rebuild(posit, j->begin, j->end);
+                rebuild(items, j->begin, j->end);
+        }
+    }
+    std::reverse(items.begin(), items.end());
+    expression->expression = alternate(items);
+}
+
+EpsilonNfaVisitor::EpsilonNfaVisitor(bool t) : tagged(t) { }
+
+void EpsilonNfaVisitor::descend(Expression *expression) {
+    frames.emplace_back(expression);
+}
+
+EpsilonNfa EpsilonNfaVisitor::build(Expression *expression, Automaton *automaton) {
+    size_t base = frames.size();
+    descend(expression);
+    while (frames.size() > base) {
+        size_t depth = frames.size();
+        EpsilonNfa nfa = invoke(frames.back().expression, automaton);
+        if (frames.size() == depth) {
+            frames.pop_back();
+            built = std::move(nfa);
         }
     }
-    expression->expression = posit;
+    return std::move(built);
 }
 
 EpsilonNfa EpsilonNfaVisitor::connect(EpsilonNfa a, EpsilonNfa b, Automaton *automaton) {
@@ -243,7 +328,7 @@ EpsilonNfa EpsilonNfaVisitor::visit(CharRangeExpression *expression, Automaton *
     return nfa;
 }
 
-EpsilonNfa EpsilonNfaVisitor::visit(BeginExpression *expression, Automaton *automaton) {
+EpsilonNfa EpsilonNfaVisitor::visit(BeginExpression *, Automaton *automaton) {
     EpsilonNfa nfa;
     nfa.start = automaton->getState();
     nfa.finish = automaton->getState();
@@ -251,7 +336,7 @@ EpsilonNfa EpsilonNfaVisitor::visit(BeginExpression *expression, Automaton *auto
     return nfa;
 }
 
-EpsilonNfa EpsilonNfaVisitor::visit(EndExpression *expression, Automaton *automaton) {
+EpsilonNfa EpsilonNfaVisitor::visit(EndExpression *, Automaton *automaton) {
     EpsilonNfa nfa;
     nfa.start = automaton->getState();
     nfa.finish = automaton->getState();
@@ -260,72 +345,858 @@ EpsilonNfa EpsilonNfaVisitor::visit(EndExpression *expression, Automaton *automa
 }
 
 EpsilonNfa EpsilonNfaVisitor::visit(RepeatExpression *expression, Automaton *automaton) {
-    EpsilonNfa nfa;
-    for (int i = 0; i < expression->times.begin; ++i) {
-        EpsilonNfa replica = invoke(expression->expression, automaton);
-        nfa = connect(nfa, replica, automaton);
-    }
-    if (expression->times.end == -1) {
-        EpsilonNfa replica = invoke(expression->expression, automaton);
-        if (!nfa.start) {
-            nfa.start = nfa.finish = automaton->getState();
-        }
-        State::Ptr begin = nfa.finish;
-        State::Ptr end = automaton->getState();
-        if (expression->isGreedy) {
-            automaton->getEpsilon(begin, replica.start);
-            automaton->getEpsilon(replica.finish, begin);
-            automaton->getNop(begin, end);
-        } else {
-            automaton->getNop(begin, end);
-            automaton->getEpsilon(begin, replica.start);
-            automaton->getEpsilon(replica.finish, begin);
-        }
-        nfa.finish = end;
-    } else if (expression->times.end > expression->times.begin) {
-        for (int i = expression->times.begin, iend = expression->times.end; i != iend; ++i) {
-            EpsilonNfa replica = invoke(expression->expression, automaton);
-            State::Ptr begin = automaton->getState();
+    Frame &frame = frames.back();
+    EpsilonNfa &nfa = frame.nfa;
+    int32_t min = expression->times.begin, max = expression->times.end;
+    if (frame.step) {
+        int32_t copy = frame.step - 1;
+        EpsilonNfa replica = std::move(built);
+        if (copy < min) {
+            nfa = connect(nfa, replica, automaton);
+        } else if (max == -1) {
+            if (!nfa.start) {
+                nfa.start = nfa.finish = automaton->getState();
+            }
+            State::Ptr begin = nfa.finish;
             State::Ptr end = automaton->getState();
             if (expression->isGreedy) {
                 automaton->getEpsilon(begin, replica.start);
-                automaton->getEpsilon(replica.finish, end);
+                automaton->getEpsilon(replica.finish, begin);
                 automaton->getNop(begin, end);
             } else {
                 automaton->getNop(begin, end);
                 automaton->getEpsilon(begin, replica.start);
-                automaton->getEpsilon(replica.finish, end);
+                automaton->getEpsilon(replica.finish, begin);
             }
-            replica.start = begin;
-            replica.finish = end;
-            nfa = connect(nfa, replica, automaton);
+            nfa.finish = end;
+        } else {
+            if (expression->isGreedy) {
+                automaton->getEpsilon(nfa.finish, replica.start);
+                automaton->getNop(nfa.finish, frame.exit);
+            } else {
+                automaton->getNop(nfa.finish, frame.exit);
+                automaton->getEpsilon(nfa.finish, replica.start);
+            }
+            nfa.finish = replica.finish;
         }
     }
-    return nfa;
+    size_t copies = min + (max == -1 ? 1 : std::max(max - min, 0));
+    if (frame.step < copies) {
+        // x{0,n} nests as (x(x(x)?)?)?: every optional copy leaves through
+        // one shared exit, so skipping the rest is a single transition
+        if (frame.step == static_cast<size_t>(min) && max != -1) {
+            if (!nfa.start) {
+                nfa.start = nfa.finish = automaton->getState();
+            }
+            frame.exit = automaton->getState();
+        }
+        ++frame.step;
+        descend(expression->expression);
+        return EpsilonNfa();
+    }
+    if (max > min) {
+        automaton->getEpsilon(nfa.finish, frame.exit);
+        nfa.finish = frame.exit;
+    }
+    if (!nfa.start) {   // x{0}
+        nfa.start = nfa.finish = automaton->getState();
+    }
+    return std::move(nfa);
 }
 
 EpsilonNfa EpsilonNfaVisitor::visit(SetExpression *expression, Automaton *automaton) {
     assertm(!expression->isComplementary, "Unable to apply EpsilonNfaVisitor to negative SetExpression.\nPlease call setNormalize() first.");
-    if (expression->expression)
-        return invoke(expression->expression, automaton);
+    Frame &frame = frames.back();
+    if (frame.step)
+        return std::move(built);
+    if (expression->expression) {
+        ++frame.step;
+        descend(expression->expression);
+        return EpsilonNfa();
+    }
     EpsilonNfa nfa;
     nfa.start = nfa.finish = automaton->getState();
     return nfa;
 }
 
 EpsilonNfa EpsilonNfaVisitor::visit(ConcatenationExpression *expression, Automaton *automaton) {
-    return connect(invoke(expression->left, automaton), invoke(expression->right, automaton), automaton);
+    Frame &frame = frames.back();
+    if (frame.step)
+        frame.nfa = connect(std::move(frame.nfa), std::move(built), automaton);
+    if (frame.step < expression->items.size()) {
+        Expression *item = expression->items[frame.step++];
+        descend(item);
+        return EpsilonNfa();
+    }
+    return std::move(frame.nfa);
 }
 
 EpsilonNfa EpsilonNfaVisitor::visit(SelectExpression *expression, Automaton *automaton) {
+    Frame &frame = frames.back();
+    EpsilonNfa &nfa = frame.nfa;
+    if (!frame.step) {
+        nfa.start = automaton->getState();
+        nfa.finish = automaton->getState();
+    } else if (frame.alternatives.size() < frame.step)
+        frame.alternatives.emplace_back(std::move(built));
+    while (frame.step < expression->items.size()) {
+        Expression *item = expression->items[frame.step++];
+        if (item) {
+            descend(item);
+            return EpsilonNfa();
+        }
+        EpsilonNfa empty;
+        empty.start = empty.finish = automaton->getState();
+        frame.alternatives.emplace_back(empty);
+    }
+    for (auto &alternative : frame.alternatives)
+        automaton->getEpsilon(nfa.start, alternative.start);
+    for (auto &alternative : frame.alternatives)
+        automaton->getEpsilon(alternative.finish, nfa.finish);
+    return std::move(nfa);
+}
+
+EpsilonNfa EpsilonNfaVisitor::visit(GroupExpression *expression, Automaton *automaton) {
+    Frame &frame = frames.back();
+    if (!frame.step && expression->expression) {
+        ++frame.step;
+        descend(expression->expression);
+        return EpsilonNfa();
+    }
     EpsilonNfa nfa;
-    nfa.start = automaton->getState();
-    nfa.finish = automaton->getState();
-    auto a = invoke(expression->left, automaton);
-    auto b = invoke(expression->right, automaton);
-    automaton->getEpsilon(nfa.start, a.start);
-    automaton->getEpsilon(nfa.start, b.start);
-    automaton->getEpsilon(a.finish, nfa.finish);
-    automaton->getEpsilon(b.finish, nfa.finish);
+    if (expression->expression)
+        nfa = std::move(built);
+    else
+        nfa.start = nfa.finish = automaton->getState();
+    if (!tagged)
+        return nfa;
+    State::Ptr open = automaton->getState(), close = automaton->getState();
+    int32_t tag = 2 * (expression->index - 1);
+    assertm(tag >= 0, "Unable to tag a group before numberGroups()");
+    automaton->getTag(open, nfa.start, tag);
+    automaton->getTag(nfa.finish, close, tag + 1);
+    nfa.start = open;
+    nfa.finish = close;
     return nfa;
 }
+
+// the alternatives of nested selects, in order
+void FactorizationVisitor::alternatives(SelectExpression *expression, std::vector<Expression::Ptr> &alters) {
+    std::vector<Expression::Ptr> pending(1, expression);
+    while (!pending.empty()) {
+        Expression::Ptr item = pending.back();
+        pending.pop_back();
+        SelectExpression *select = expressionCast<SelectExpression>(item);
+        if (select) {
+            for (size_t i = select->items.size(); i--; )
+                pending.emplace_back(select->items[i]);
+        } else
+            alters.emplace_back(item);
+    }
+}
+
+void FactorizationVisitor::factors(Expression::Ptr expression, Factors &facts) {
+    ConcatenationExpression *concatenation = expressionCast<ConcatenationExpression>(expression);
+    if (concatenation)
+        facts.insert(facts.end(), concatenation->items.begin(), concatenation->items.end());
+    else if (expression)
+        facts.emplace_back(expression);
+}
+
+Expression::Ptr FactorizationVisitor::concatenate(Factors::const_iterator begin, Factors::const_iterator end) {
+    return ::concatenate(Factors(begin, end));
+}
+
+Expression::Ptr FactorizationVisitor::optional(Expression::Ptr expression, bool isGreedy) {
+    RepeatExpression *repeat = new RepeatExpression(0, 1, isGreedy);
+    repeat->expression = expression;
+    return Expression::Ptr(repeat);
+}
+
+// Alternatives may only be reordered across each other when no input can start both of them
+bool FactorizationVisitor::hoppable(Expression::Ptr a, Expression::Ptr b) {
+    CharRangeExpression *lhs = expressionCast<CharRangeExpression>(a);
+    CharRangeExpression *rhs = expressionCast<CharRangeExpression>(b);
+    return lhs && rhs && (lhs->range.end < rhs->range.begin || rhs->range.end < lhs->range.begin);
+}
+
+// A head matching in more than one way would try all of x before the next way of a in a(x|y)
+bool FactorizationVisitor::hoistable(Expression::Ptr head) {
+    SetExpression *set = expressionCast<SetExpression>(head);
+    return expressionCast<CharRangeExpression>(head) || (set && set->expression);
+}
+
+/**
+ *  a x | a y | b   =>   a (x | y) | b, for a head a that reads one character
+ *  an empty tail keeps its priority: a | a y  =>  a (y)??,  a y | a  =>  a (y)?
+**/
+Expression::Ptr FactorizationVisitor::merge(std::vector<Factors> alters) {
+    struct Group {
+        Expression::Ptr head = nullptr;
+        std::vector<Factors> tails;
+    };
+    std::vector<Group> groups;
+    bool hasEmpty = false;
+    for (auto &alter : alters) {
+        if (alter.empty()) {
+            if (!hasEmpty)
+                groups.emplace_back();
+            hasEmpty = true;
+            continue;
+        }
+        auto group = groups.rbegin(), gend = groups.rend();
+        for (; group != gend; ++group) {
+            if (group->head && hoistable(group->head) && group->head->equals(alter.front()))
+                break;
+            if (!hoppable(group->head, alter.front())) {
+                group = gend;
+                break;
+            }
+        }
+        if (group == gend) {
+            groups.emplace_back();
+            groups.back().head = alter.front();
+            group = groups.rbegin();
+        }
+        group->tails.emplace_back(alter.begin()+1, alter.end());
+    }
+
+    std::vector<Factors> prefixed;
+    for (auto &group : groups) {
+        prefixed.emplace_back();
+        if (!group.head)
+            continue;
+        if (group.tails.size() == 1) {
+            prefixed.back().emplace_back(group.head);
+            prefixed.back().insert(prefixed.back().end(), group.tails[0].begin(), group.tails[0].end());
+        } else {
+            prefixed.back().emplace_back(group.head);
+            Expression::Ptr tail = merge(group.tails);
+            if (tail)
+                prefixed.back().emplace_back(tail);
+        }
+    }
+    return mergeSuffixes(prefixed);
+}
+
+/**
+ *  x a | y a   =>   (x | y) a
+**/
+Expression::Ptr FactorizationVisitor::mergeSuffixes(std::vector<Factors> alters) {
+    std::vector<Expression::Ptr> before, after;
+    bool hasEmpty = false;
+    for (size_t i = 0, iend = alters.size(), j; i != iend; i = j) {
+        j = i + 1;
+        if (alters[i].empty()) {
+            hasEmpty = true;
+            continue;
+        }
+        while (j != iend && !alters[j].empty() && alters[j].back()->equals(alters[i].back()))
+            ++j;
+        Expression::Ptr alter = nullptr;
+        if (j - i > 1) {
+            std::vector<Factors> heads;
+            for (size_t k = i; k != j; ++k)
+                heads.emplace_back(alters[k].begin(), alters[k].end()-1);
+            Factors merged;
+            factors(merge(heads), merged);
+            merged.emplace_back(alters[i].back());
+            alter = concatenate(merged.begin(), merged.end());
+        } else
+            alter = concatenate(alters[i].begin(), alters[i].end());
+        (hasEmpty ? after : before).emplace_back(alter);
+    }
+
+    Expression::Ptr lhs = alternate(before), rhs = alternate(after);
+    if (!hasEmpty)
+        return lhs;
+    if (!rhs)
+        return lhs ? optional(lhs, true) : nullptr;
+    rhs = optional(rhs, false);
+    if (!lhs)
+        return rhs;
+    return alternate({lhs, rhs});
+}
+
+Expression::Ptr FactorizationVisitor::visit(CharRangeExpression *expression, void *) {
+    return expression;
+}
+
+Expression::Ptr FactorizationVisitor::visit(BeginExpression *expression, void *) {
+    return expression;
+}
+
+Expression::Ptr FactorizationVisitor::visit(EndExpression *expression, void *) {
+    return expression;
+}
+
+Expression::Ptr FactorizationVisitor::visit(RepeatExpression *expression, void *) {
+    Frame &frame = frames.back();
+    if (frame.step) {
+        expression->expression = built;
+        return expression;
+    }
+    ++frame.step;
+    descend(expression->expression);
+    return nullptr;
+}
+
+Expression::Ptr FactorizationVisitor::visit(SetExpression *expression, void *) {
+    return expression;
+}
+
+Expression::Ptr FactorizationVisitor::visit(ConcatenationExpression *expression, void *) {
+    Frame &frame = frames.back();
+    if (frame.step)
+        expression->items[frame.step - 1] = built;
+    if (frame.step < expression->items.size()) {
+        Expression *item = expression->items[frame.step++];
+        descend(item);
+        return nullptr;
+    }
+    return expression;
+}
+
+// every alternative is factored on its own before they are merged
+Expression::Ptr FactorizationVisitor::visit(SelectExpression *expression, void *) {
+    Frame &frame = frames.back();
+    if (!frame.step)
+        alternatives(expression, frame.items);
+    else
+        frame.items[frame.step - 1] = built;
+    while (frame.step < frame.items.size()) {
+        Expression *item = frame.items[frame.step++];
+        if (item) {
+            descend(item);
+            return nullptr;
+        }
+    }
+    std::vector<Factors> alters;
+    for (auto item : frame.items) {
+        alters.emplace_back();
+        factors(item, alters.back());
+    }
+    Expression::Ptr merged = merge(alters);
+    return merged ? merged : expression;
+}
+
+Expression::Ptr FactorizationVisitor::visit(GroupExpression *expression, void *) {
+    // a group is a unit of its own: nothing is factored across its parentheses
+    Frame &frame = frames.back();
+    if (frame.step)
+        expression->expression = built;
+    else if (expression->expression) {
+        ++frame.step;
+        descend(expression->expression);
+        return nullptr;
+    }
+    return expression;
+}
+
+/**
+ *  children are pushed in reverse so that groups are numbered in the order
+ *  of their opening parentheses, without recursing on nested groups
+**/
+int32_t GroupNumberingVisitor::number(Expression::Ptr expression) {
+    int32_t count = 0;
+    pending.assign(1, expression);
+    while (!pending.empty()) {
+        auto next = pending.back();
+        pending.pop_back();
+        if (next)
+            invoke(next, &count);
+    }
+    return count;
+}
+
+void GroupNumberingVisitor::visit(CharRangeExpression *, int32_t *) { }
+void GroupNumberingVisitor::visit(BeginExpression *, int32_t *) { }
+void GroupNumberingVisitor::visit(EndExpression *, int32_t *) { }
+void GroupNumberingVisitor::visit(RepeatExpression *expression, int32_t *) {
+    pending.emplace_back(expression->expression);
+}
+void GroupNumberingVisitor::visit(SetExpression *, int32_t *) { }
+void GroupNumberingVisitor::visit(ConcatenationExpression *expression, int32_t *) {
+    for (size_t i = expression->items.size(); i--; )
+        pending.emplace_back(expression->items[i]);
+}
+void GroupNumberingVisitor::visit(SelectExpression *expression, int32_t *) {
+    for (size_t i = expression->items.size(); i--; )
+        pending.emplace_back(expression->items[i]);
+}
+void GroupNumberingVisitor::visit(GroupExpression *expression, int32_t *count) {
+    expression->index = ++*count;
+    pending.emplace_back(expression->expression);
+}
+
+int64_t NfaSizeVisitor::visit(CharRangeExpression *, void *) {
+    return 2;
+}
+int64_t NfaSizeVisitor::visit(BeginExpression *, void *) {
+    return 2;
+}
+int64_t NfaSizeVisitor::visit(EndExpression *, void *) {
+    return 2;
+}
+int64_t NfaSizeVisitor::visit(RepeatExpression *expression, void *) {
+    Frame &frame = frames.back();
+    if (!frame.step) {
+        ++frame.step;
+        descend(expression->expression);
+        return 0;
+    }
+    int64_t size = built;
+    int64_t min = expression->times.begin, max = expression->times.end;
+    int64_t states = min * size;
+    if (max == -1)
+        states += size + (min ? 0 : 1) + 1;
+    else if (max > min)
+        states += (min ? 0 : 1) + (max - min) * size + 1;
+    return states ? states : 1;
+}
+int64_t NfaSizeVisitor::visit(SetExpression *expression, void *) {
+    Frame &frame = frames.back();
+    if (frame.step)
+        return built;
+    if (!expression->expression)
+        return 1;
+    ++frame.step;
+    descend(expression->expression);
+    return 0;
+}
+int64_t NfaSizeVisitor::visit(ConcatenationExpression *expression, void *) {
+    Frame &frame = frames.back();
+    if (frame.step)
+        frame.value += built;
+    if (frame.step < expression->items.size()) {
+        Expression *item = expression->items[frame.step++];
+        descend(item);
+        return 0;
+    }
+    return frame.value;
+}
+int64_t NfaSizeVisitor::visit(SelectExpression *expression, void *) {
+    Frame &frame = frames.back();
+    frame.value += frame.step ? built : 2;
+    while (frame.step < expression->items.size()) {
+        Expression *item = expression->items[frame.step++];
+        if (item) {
+            descend(item);
+            return 0;
+        }
+        frame.value += 1;
+    }
+    return frame.value;
+}
+int64_t NfaSizeVisitor::visit(GroupExpression *expression, void *) {
+    Frame &frame = frames.back();
+    if (frame.step)
+        return built;
+    if (!expression->expression)
+        return 1;
+    ++frame.step;
+    descend(expression->expression);
+    return 0;
+}
+
+SimplificationStatistics::SimplificationStatistics() : rewrites(), statesSaved() { }
+
+namespace {
+// [] takes no character, so it matches the empty string
+bool isEmptySet(Expression::Ptr expression) {
+    SetExpression *set = expressionCast<SetExpression>(expression);
+    return set && !set->isComplementary && !set->expression;
+}
+
+bool isCharClass(Expression::Ptr expression) {
+    SetExpression *set = expressionCast<SetExpression>(expression);
+    return expressionCast<CharRangeExpression>(expression) || (set && set->expression);
+}
+
+// as an alternative, an empty expression is the one state it takes
+int64_t nfaSize(Expression::Ptr expression) {
+    return expression ? NfaSizeVisitor().invoke(expression, nullptr) : 1;
+}
+}
+
+SimplificationVisitor::SimplificationVisitor(bool keep, SimplificationStatistics *stats) : keepGroups(keep), statistics(stats), changes(0) { }
+
+int64_t SimplificationVisitor::states(Expression::Ptr expression) {
+    return statistics ? nfaSize(expression) : 0;
+}
+
+void SimplificationVisitor::rewrite(SimplificationStatistics::Rule rule, int64_t before, int64_t after) {
+    ++changes;
+    if (statistics) {
+        ++statistics->rewrites[rule];
+        statistics->statesSaved[rule] += before - after;
+    }
+}
+
+// a select an alternative simplifies to is spliced in, saving its two states
+void SimplificationVisitor::alternatives(const std::vector<Expression::Ptr> &items, std::vector<Expression::Ptr> &alters) {
+    for (auto item : items) {
+        SelectExpression *select = expressionCast<SelectExpression>(item);
+        if (select) {
+            alters.insert(alters.end(), select->items.begin(), select->items.end());
+            if (statistics)
+                statistics->statesSaved[SimplificationStatistics::Ungroup] += 2;
+        } else
+            alters.emplace_back(item);
+    }
+}
+
+Expression::Ptr SimplificationVisitor::visit(CharRangeExpression *expression, void *) {
+    return expression;
+}
+
+Expression::Ptr SimplificationVisitor::visit(BeginExpression *expression, void *) {
+    return expression;
+}
+
+Expression::Ptr SimplificationVisitor::visit(EndExpression *expression, void *) {
+    return expression;
+}
+
+// only *, + and ? of the same greediness nest into one another
+Expression::Ptr SimplificationVisitor::visit(RepeatExpression *expression, void *) {
+    Frame &frame = frames.back();
+    if (frame.step)
+        expression->expression = built;
+    else if (expression->expression) {
+        ++frame.step;
+        descend(expression->expression);
+        return nullptr;
+    }
+    Expression::Ptr self = expression;
+    Expression::Ptr child = expression->expression;
+    if (isEmptySet(child)) {
+        rewrite(SimplificationStatistics::EmptySet, states(self), states(child));
+        return child;
+    }
+    if (expression->times.begin == 1 && expression->times.end == 1) {
+        rewrite(SimplificationStatistics::UnitRepeat, states(self), states(child));
+        return child;
+    }
+    auto isSimple = [](const Range<int32_t> &times) {
+        return times.begin <= 1 && (times.end == -1 || (times.begin == 0 && times.end == 1));
+    };
+    RepeatExpression *inner = expressionCast<RepeatExpression>(child);
+    if (inner && inner->isGreedy == expression->isGreedy && isSimple(inner->times) && isSimple(expression->times)) {
+        bool plus = inner->times.begin == 1 && expression->times.begin == 1;
+        bool question = inner->times.end == 1 && expression->times.end == 1;
+        RepeatExpression *repeat = new RepeatExpression(plus ? 1 : 0, question ? 1 : -1, expression->isGreedy);
+        repeat->expression = inner->expression;
+        Expression::Ptr flat(repeat);
+        rewrite(SimplificationStatistics::NestedRepeat, states(self), states(flat));
+        return flat;
+    }
+    return self;
+}
+
+Expression::Ptr SimplificationVisitor::visit(SetExpression *expression, void *) {
+    Expression::Ptr self = expression;
+    if (!expression->expression || expression->isComplementary)
+        return self;
+    Expression::Ptr only = expression->expression;
+    if (expressionCast<CharRangeExpression>(only) || expressionCast<SetExpression>(only)) {
+        rewrite(SimplificationStatistics::RedundantSet, states(self), states(only));
+        return only;
+    }
+    return self;
+}
+
+Expression::Ptr SimplificationVisitor::visit(ConcatenationExpression *expression, void *) {
+    Frame &frame = frames.back();
+    if (frame.step)
+        expression->items[frame.step - 1] = built;
+    if (frame.step < expression->items.size()) {
+        Expression *item = expression->items[frame.step++];
+        descend(item);
+        return nullptr;
+    }
+    std::vector<Expression::Ptr> items;
+    bool changed = false;
+    for (auto &item : expression->items) {
+        if (isEmptySet(item)) {
+            if (items.empty() && &item == &expression->items.back())
+                return item;    // nothing but []
+            rewrite(SimplificationStatistics::EmptySet, states(item), 0);
+            changed = true;
+        } else {
+            changed = changed || expressionCast<ConcatenationExpression>(item);
+            items.emplace_back(item);
+        }
+    }
+    return changed ? concatenate(items) : expression;
+}
+
+/**
+ *  Dropping a later copy of an alternative never changes what matches
+ *  first, and neither does joining adjacent character classes: either
+ *  reads the one byte and goes on alike.
+**/
+Expression::Ptr SimplificationVisitor::visit(SelectExpression *expression, void *) {
+    Frame &frame = frames.back();
+    if (frame.step)
+        frame.items.back() = built;
+    while (frame.step < expression->items.size()) {
+        Expression *item = expression->items[frame.step++];
+        frame.items.emplace_back(item);
+        if (item) {
+            descend(item);
+            return nullptr;
+        }
+    }
+    std::vector<Expression::Ptr> alters, unique, merged;
+    std::vector<uint64_t> hashes;
+    bool merging = false;
+    alternatives(frame.items, alters);
+    for (auto &alter : alters) {
+        uint64_t hash = alter ? StructuralHashVisitor().invoke(alter, nullptr) : 0;
+        bool duplicate = false;
+        for (size_t i = 0; i < unique.size() && !duplicate; ++i)
+            duplicate = hashes[i] == hash && alter && unique[i] && unique[i]->equals(alter);
+        if (duplicate)
+            rewrite(SimplificationStatistics::DuplicateAlternative, states(alter), 0);
+        else {
+            unique.emplace_back(alter);
+            hashes.emplace_back(hash);
+        }
+    }
+    for (size_t i = 0, j; i < unique.size(); i = j) {
+        for (j = i; j < unique.size() && isCharClass(unique[j]); ++j)
+            ;
+        if (j - i < 2) {
+            j = std::max(j, i + 1);
+            merged.insert(merged.end(), unique.begin() + i, unique.begin() + j);
+            continue;
+        }
+        int64_t before = 0;
+        Range<unsigned char>::List ranges;
+        std::vector<Expression::Ptr> items;
+        for (size_t k = i; k != j; ++k) {
+            before += states(unique[k]);
+            Expression::Ptr item = unique[k];
+            SetExpression *set = expressionCast<SetExpression>(item);
+            if (set) {
+                set->setNormalize(&ranges);
+                item = set->expression;
+            }
+            if (item)
+                items.emplace_back(item);
+        }
+        SetExpression *set = new SetExpression;
+        set->isComplementary = false;
+        set->expression = alternate(items);
+        Expression::Ptr joined(set);
+        joined->setNormalize(&ranges);
+        rewrite(SimplificationStatistics::MergeRanges, before, states(joined));
+        merged.emplace_back(joined);
+        merging = true;
+    }
+    if (merged.size() == expression->items.size() && std::equal(merged.begin(), merged.end(), expression->items.begin()))
+        return expression;
+    // the select itself is gone too
+    if (merged.size() == 1 && statistics)
+        statistics->statesSaved[merging ? SimplificationStatistics::MergeRanges : SimplificationStatistics::DuplicateAlternative] += 2;
+    return alternate(merged);
+}
+
+Expression::Ptr SimplificationVisitor::visit(GroupExpression *expression, void *) {
+    Frame &frame = frames.back();
+    if (frame.step)
+        expression->expression = built;
+    else if (expression->expression) {
+        ++frame.step;
+        descend(expression->expression);
+        return nullptr;
+    }
+    Expression::Ptr self = expression;
+    if (keepGroups)
+        return self;
+    Expression::Ptr child = expression->expression;
+    if (!child) {
+        SetExpression *empty = new SetExpression;
+        empty->isComplementary = false;
+        child = empty;
+    }
+    rewrite(SimplificationStatistics::Ungroup, states(self), states(child));
+    return child;
+}
+
+uint64_t StructuralHashVisitor::mix(uint64_t hash, uint64_t value) {
+    return hash ^ (value + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2));
+}
+uint64_t StructuralHashVisitor::visit(CharRangeExpression *expression, void *) {
+    return mix(mix(1, expression->range.begin), expression->range.end);
+}
+uint64_t StructuralHashVisitor::visit(BeginExpression *, void *) {
+    return mix(0, 2);
+}
+uint64_t StructuralHashVisitor::visit(EndExpression *, void *) {
+    return mix(0, 3);
+}
+uint64_t StructuralHashVisitor::visit(RepeatExpression *expression, void *) {
+    Frame &frame = frames.back();
+    if (!frame.step) {
+        ++frame.step;
+        descend(expression->expression);
+        return 0;
+    }
+    uint64_t hash = mix(mix(mix(4, expression->times.begin), expression->times.end), expression->isGreedy);
+    return mix(hash, built);
+}
+uint64_t StructuralHashVisitor::visit(SetExpression *expression, void *) {
+    Frame &frame = frames.back();
+    if (!frame.step && expression->expression) {
+        ++frame.step;
+        descend(expression->expression);
+        return 0;
+    }
+    return mix(mix(5, expression->isComplementary), frame.step ? built : 0);
+}
+uint64_t StructuralHashVisitor::visit(ConcatenationExpression *expression, void *) {
+    Frame &frame = frames.back();
+    frame.value = frame.step ? mix(frame.value, built) : 6;
+    if (frame.step < expression->items.size()) {
+        Expression *item = expression->items[frame.step++];
+        descend(item);
+        return 0;
+    }
+    return frame.value;
+}
+uint64_t StructuralHashVisitor::visit(SelectExpression *expression, void *) {
+    Frame &frame = frames.back();
+    frame.value = frame.step ? mix(frame.value, built) : 7;
+    while (frame.step < expression->items.size()) {
+        Expression *item = expression->items[frame.step++];
+        if (item) {
+            descend(item);
+            return 0;
+        }
+        frame.value = mix(frame.value, 0);
+    }
+    return frame.value;
+}
+uint64_t StructuralHashVisitor::visit(GroupExpression *expression, void *) {
+    Frame &frame = frames.back();
+    if (!frame.step && expression->expression) {
+        ++frame.step;
+        descend(expression->expression);
+        return 0;
+    }
+    return mix(mix(8, expression->index), frame.step ? built : 0);
+}
+
+// the same hashes as StructuralHashVisitor, from the remembered ones of the children
+Expression::Ptr InterningVisitor::intern(Expression::Ptr expression) {
+    return expression ? invoke(expression, nullptr) : expression;
+}
+
+Expression::Ptr InterningVisitor::intern(Expression::Ptr expression, uint64_t hash) {
+    auto range = table.equal_range(hash);
+    for (auto i = range.first; i != range.second; ++i) {
+        if (i->second->equals(expression))
+            return i->second;
+    }
+    table.emplace(hash, expression);
+    hashes.emplace(expression, hash);
+    return expression;
+}
+
+uint64_t InterningVisitor::childHash(Expression::Ptr expression) {
+    return expression ? hashes.at(expression) : 0;
+}
+
+uint64_t InterningVisitor::hash(Expression::Ptr expression) {
+    auto found = hashes.find(expression);
+    if (found != hashes.end())
+        return found->second;
+    return expression ? StructuralHashVisitor().invoke(expression, nullptr) : 0;
+}
+
+Expression::Ptr InterningVisitor::visit(CharRangeExpression *expression, void *) {
+    using H = StructuralHashVisitor;
+    return intern(expression, H::mix(H::mix(1, expression->range.begin), expression->range.end));
+}
+
+Expression::Ptr InterningVisitor::visit(BeginExpression *expression, void *) {
+    return intern(expression, StructuralHashVisitor::mix(0, 2));
+}
+
+Expression::Ptr InterningVisitor::visit(EndExpression *expression, void *) {
+    return intern(expression, StructuralHashVisitor::mix(0, 3));
+}
+
+Expression::Ptr InterningVisitor::visit(RepeatExpression *expression, void *) {
+    using H = StructuralHashVisitor;
+    Frame &frame = frames.back();
+    if (frame.step)
+        expression->expression = built;
+    else if (expression->expression) {
+        ++frame.step;
+        descend(expression->expression);
+        return nullptr;
+    }
+    uint64_t hash = H::mix(H::mix(H::mix(4, expression->times.begin), expression->times.end), expression->isGreedy);
+    return intern(expression, H::mix(hash, childHash(expression->expression)));
+}
+
+Expression::Ptr InterningVisitor::visit(SetExpression *expression, void *) {
+    using H = StructuralHashVisitor;
+    Frame &frame = frames.back();
+    if (frame.step)
+        expression->expression = built;
+    else if (expression->expression) {
+        ++frame.step;
+        descend(expression->expression);
+        return nullptr;
+    }
+    return intern(expression, H::mix(H::mix(5, expression->isComplementary), childHash(expression->expression)));
+}
+
+Expression::Ptr InterningVisitor::visit(ConcatenationExpression *expression, void *) {
+    Frame &frame = frames.back();
+    if (frame.step)
+        expression->items[frame.step - 1] = built;
+    if (frame.step < expression->items.size()) {
+        Expression *item = expression->items[frame.step++];
+        descend(item);
+        return nullptr;
+    }
+    uint64_t hash = 6;
+    for (auto item : expression->items)
+        hash = StructuralHashVisitor::mix(hash, childHash(item));
+    return intern(expression, hash);
+}
+
+Expression::Ptr InterningVisitor::visit(SelectExpression *expression, void *) {
+    Frame &frame = frames.back();
+    if (frame.step)
+        expression->items[frame.step - 1] = built;
+    while (frame.step < expression->items.size()) {
+        Expression *item = expression->items[frame.step++];
+        if (item) {
+            descend(item);
+            return nullptr;
+        }
+    }
+    uint64_t hash = 7;
+    for (auto item : expression->items)
+        hash = StructuralHashVisitor::mix(hash, childHash(item));
+    return intern(expression, hash);
+}
+
+Expression::Ptr InterningVisitor::visit(GroupExpression *expression, void *) {
+    using H = StructuralHashVisitor;
+    Frame &frame = frames.back();
+    if (frame.step)
+        expression->expression = built;
+    else if (expression->expression) {
+        ++frame.step;
+        descend(expression->expression);
+        return nullptr;
+    }
+    return intern(expression, H::mix(H::mix(8, expression->index), childHash(expression->expression)));
+}
@@ -0,0 +1,181 @@
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <iostream>
+#include <vector>
+#include "regex_codegen.h"
+
+namespace {
+constexpr int CasesPerLine = 8;
+
+std::string hex(unsigned c) {
+    char buffer[8];
+    snprintf(buffer, sizeof(buffer), "0x%02x", c);
+    return buffer;
+}
+
+std::string guard(const std::string &name, const std::string &suffix) {
+    std::string result;
+    for (char c : name)
+        result += isalnum(static_cast<unsigned char>(c)) ? toupper(static_cast<unsigned char>(c)) : '_';
+    return result + suffix;
+}
+
+template <typename Value>
+void generateArray(const std::string &type, const std::string &name, const std::vector<Value> &values, int perLine, std::ostream &os) {
+    os << "constexpr " << type << " " << name << "[" << values.size() << "] = {";
+    for (size_t i = 0; i < values.size(); ++i) {
+        os << (i % perLine == 0 ? "\n    " : " ") << static_cast<long>(values[i]);
+        if (i + 1 != values.size())
+            os << ",";
+    }
+    os << "\n};\n";
+}
+
+/**
+ *  The tables of a PoorInterpreter, which both generators emit: --tables
+ *  as constexpr arrays and --cpp as one block of code per state.
+**/
+struct Tables {
+    int32_t stateCount;
+    int32_t charCategories;
+    std::vector<int16_t> charMap;
+    std::vector<int32_t> transitions;
+    std::vector<uint8_t> accepted;
+    std::vector<uint8_t> acceptedAtEnd;
+
+    explicit Tables(const PoorInterpreter &interpreter)
+            : stateCount(interpreter.getStateCount()), charCategories(interpreter.getCharCategories()),
+              charMap(PoorInterpreter::CharMapSize) {
+        for (int c = 0; c < PoorInterpreter::CharMapSize; ++c)
+            charMap[c] = interpreter.getCharCategory(c);
+        for (int32_t state = 0; state < stateCount; ++state) {
+            for (int32_t category = 0; category < charCategories; ++category)
+                transitions.push_back(interpreter.getTransition(state, category));
+            accepted.push_back(interpreter.isAccepted(state));
+            acceptedAtEnd.push_back(interpreter.isAcceptedAtEnd(state));
+        }
+    }
+    int32_t transit(int32_t state, unsigned char c) const {
+        return transitions[state * charCategories + charMap[c]];
+    }
+};
+
+// Wraps what body writes in the include guard and banner of a generated header
+template <typename Body>
+void generateHeader(const std::string &option, const std::string &macro, const std::string &include, std::ostream &os, Body body) {
+    os << "// Generated by toy-yacc " << option << ". Do not edit.\n"
+       << "#ifndef " << macro << "\n"
+       << "#define " << macro << "\n\n"
+       << "#include " << include << "\n\n";
+    body();
+    os << "#endif\n";
+}
+
+// A state's body: record acceptance, stop at the end of input, then dispatch
+// on the next byte through one switch the compiler may lower to a jump table.
+void generateState(const Tables &tables, int32_t state, const std::vector<int32_t> &ids, bool isTarget, std::ostream &os) {
+    int32_t id = ids[state];
+    if (isTarget)
+        os << "s" << id << ":\n";
+    if (tables.accepted[state])
+        os << "    accepted = p - begin;\n";
+    // bytes leading to the same state share one group of case labels
+    std::vector<std::pair<int32_t, std::vector<unsigned>>> groups;
+    for (unsigned c = 0; c < PoorInterpreter::CharMapSize; ++c) {
+        int32_t target = tables.transit(state, c);
+        if (target == PoorInterpreter::InvalidState)
+            continue;
+        target = ids[target];
+        auto group = std::find_if(groups.begin(), groups.end(), [target](const std::pair<int32_t, std::vector<unsigned>> &g) {
+            return g.first == target;
+        });
+        if (group == groups.end())
+            groups.emplace_back(target, std::vector<unsigned>(1, c));
+        else
+            group->second.push_back(c);
+    }
+    if (groups.empty()) {
+        os << "    return accepted;\n";
+        return;
+    }
+    os << "    if (p == end)\n"
+       << "        return accepted;\n"
+       << "    switch (*p++) {\n";
+    for (auto &group : groups) {
+        int count = 0;
+        for (auto c : group.second) {
+            os << (count % CasesPerLine == 0 ? "        " : " ") << "case " << hex(c) << ":";
+            if (++count % CasesPerLine == 0)
+                os << "\n";
+        }
+        if (count % CasesPerLine != 0)
+            os << "\n";
+        os << "            goto s" << group.first << ";\n";
+    }
+    os << "        default:\n"
+       << "            return accepted;\n"
+       << "    }\n";
+}
+}
+
+void generateCpp(const PoorInterpreter &interpreter, const std::string &name, std::ostream &os) {
+    Tables tables(interpreter);
+    // number states breadth-first from the start so that it falls through first
+    std::vector<int32_t> order, ids(tables.stateCount, PoorInterpreter::InvalidState);
+    std::vector<bool> targets(tables.stateCount);
+    ids[interpreter.getStartState()] = 0;
+    order.push_back(interpreter.getStartState());
+    for (size_t i = 0; i < order.size(); ++i) {
+        for (unsigned c = 0; c < PoorInterpreter::CharMapSize; ++c) {
+            int32_t target = tables.transit(order[i], c);
+            if (target == PoorInterpreter::InvalidState)
+                continue;
+            if (ids[target] == PoorInterpreter::InvalidState) {
+                ids[target] = order.size();
+                order.push_back(target);
+            }
+            targets[ids[target]] = true;
+        }
+    }
+
+    generateHeader("--cpp", guard(name, "_RE_H"), "<cstddef>", os, [&]() {
+        os << "// length of the longest match of " << name << " at input, or -1\n"
+           << "static inline long " << name << "Head(const char *input, size_t length) {\n"
+           << "    const unsigned char *begin = reinterpret_cast<const unsigned char *>(input);\n"
+           << "    const unsigned char *p = begin, *end = begin + length;\n"
+           << "    long accepted = -1;\n";
+        for (size_t i = 0; i < order.size(); ++i)
+            generateState(tables, order[i], ids, targets[i], os);
+        os << "}\n\n"
+           << "static inline bool " << name << "Match(const char *input, size_t length) {\n"
+           << "    return " << name << "Head(input, length) == static_cast<long>(length);\n"
+           << "}\n\n"
+           << "// leftmost-longest match of " << name << " in input\n"
+           << "static inline bool " << name << "Search(const char *input, size_t length, size_t *start, size_t *matchLength) {\n"
+           << "    for (size_t offset = 0; offset <= length; ++offset) {\n"
+           << "        long head = " << name << "Head(input + offset, length - offset);\n"
+           << "        if (head >= 0) {\n"
+           << "            *start = offset;\n"
+           << "            *matchLength = head;\n"
+           << "            return true;\n"
+           << "        }\n"
+           << "    }\n"
+           << "    return false;\n"
+           << "}\n\n";
+    });
+}
+
+void generateTables(const PoorInterpreter &interpreter, const std::string &name, std::ostream &os) {
+    Tables tables(interpreter);
+    generateHeader("--tables", guard(name, "_TABLES_H"), "\"static_interpreter.h\"", os, [&]() {
+        generateArray("int16_t", name + "CharMap", tables.charMap, 16, os);
+        generateArray("int32_t", name + "Transitions", tables.transitions, tables.charCategories, os);
+        generateArray("uint8_t", name + "Accepted", tables.accepted, 16, os);
+        generateArray("uint8_t", name + "AcceptedAtEnd", tables.acceptedAtEnd, 16, os);
+        os << "\nconstexpr StaticInterpreter " << name << "Interpreter(" << name << "CharMap, " << name << "Transitions, "
+           << name << "Accepted, " << name << "AcceptedAtEnd, " << tables.stateCount << ", " << tables.charCategories << ", "
+           << interpreter.getStartState() << ", " << interpreter.getBeginState() << ", "
+           << (interpreter.isAnchoredAtBegin() ? "true" : "false") << ");\n\n";
+    });
+}
@@ -0,0 +1,555 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <set>
+#include <unistd.h>
+#include "regex_compiler.h"
+#include "regex_exception.h"
+#include "regex_expression.h"
+
+namespace {
+constexpr uint64_t FnvOffsetBasis = 14695981039346656037ULL;
+constexpr uint64_t FnvPrime = 1099511628211ULL;
+// forward DFA states allowed per NFA state before Automatic turns to Brzozowski
+constexpr size_t AutomaticStateFactor = 4;
+
+uint64_t fnv1a(uint64_t hash, const void *data, size_t length) {
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    for (size_t i = 0; i < length; ++i) {
+        hash ^= bytes[i];
+        hash *= FnvPrime;
+    }
+    return hash;
+}
+
+// what a program was compiled from, in full; cacheDirectory does not change it
+std::string describe(const std::string &pattern, const CompileOptions &options) {
+    std::string description(1, options.factorize ? '1' : '0');
+    description += static_cast<char>('0' + static_cast<int>(options.minimization));
+    description += static_cast<char>('0' + static_cast<int>(options.semantics));
+    return description + pattern;
+}
+
+// Writers race on the same key freely: each one fills a private temporary
+// file and renames it over the entry, which readers only ever see whole.
+void store(PoorInterpreter::Ptr interpreter, const std::string &path, const std::string &label) {
+    static std::atomic<unsigned> sequence(0);
+    std::string temporary = path + ".tmp." + std::to_string(getpid()) + "." + std::to_string(sequence++);
+    {
+        std::ofstream ofs(temporary, std::ios::binary);
+        if (!ofs)
+            return;
+        interpreter->save(ofs, label);
+        ofs.flush();
+        if (!ofs) {
+            ofs.close();
+            remove(temporary.c_str());
+            return;
+        }
+    }
+    if (rename(temporary.c_str(), path.c_str()) != 0)
+        remove(temporary.c_str());
+}
+
+// parse and simplify, then bring the character sets to one disjoint partition
+Expression::Ptr prepare(const std::string &pattern, const CompileOptions &options, Range<unsigned char>::List &unifiedRanges, bool captures=false) {
+    auto regex = simplify(parseRegex(pattern), captures);
+    regex->setNormalize(&unifiedRanges);
+    regex->setUnify(unifiedRanges);
+    if (options.factorize)
+        regex = factorize(regex);
+    return regex;
+}
+
+// reversal would turn ^ into $ and back and loses the priority of the NFA
+// transitions, so anchored NFAs and leftmost-first always go forward
+Automaton::Ptr determinize(Automaton::Ptr nfa, const CompileOptions &options) {
+    bool leftmostFirst = options.semantics == Semantics::LeftmostFirst;
+    bool forwardOnly = leftmostFirst || nfa->hasAnchors();
+    if (options.minimization == Minimization::Brzozowski && !forwardOnly)
+        return Brzozowski(nfa, poorEpsilonChecker);
+    size_t stateLimit = 0;
+    if (options.minimization == Minimization::Automatic && !forwardOnly)
+        stateLimit = AutomaticStateFactor * nfa->states.size();
+    std::map<State::List, State::Ptr> nfaStateMap;
+    auto dfa = powerset(nfa, poorEpsilonChecker, nfaStateMap, stateLimit, poorBeginChecker, leftmostFirst);
+    if (!dfa)
+        return Brzozowski(nfa, poorEpsilonChecker);
+    std::map<State::Ptr, State::Ptr> dfaStateMap;
+    return Hopcroft(dfa, dfaStateMap);
+}
+
+// a trailing $ of the top-level concatenation is dropped and reported
+Expression::Ptr stripEndAnchor(Expression::Ptr regex, bool &isAnchored) {
+    isAnchored = false;
+    auto concatenation = expressionCast<ConcatenationExpression>(regex);
+    if (!concatenation || !expressionCast<EndExpression>(concatenation->items.back()))
+        return regex;
+    isAnchored = true;
+    return concatenate(std::vector<Expression::Ptr>(concatenation->items.begin(), concatenation->items.end() - 1));
+}
+
+// an NFA state a tagged DFA state keeps: one that reads a byte or accepts
+struct Thread {
+    State::Ptr state;
+    // the thread of the previous DFA state it continues
+    int32_t source;
+    // the tags passed since
+    std::vector<int32_t> tags;
+};
+
+// epsilonClosure() keeping the tags of every path, cut at the first accept
+void taggedClosure(State::Ptr state, int32_t source, bool atBegin, std::vector<int32_t> &tags,
+                   std::set<State *> &visited, std::vector<Thread> &threads, bool &cut) {
+    if (cut || !visited.insert(state.get()).second)
+        return;
+    bool reads = false;
+    for (auto &transition : state->outbounds)
+        reads |= transition->type == Transition::Chars;
+    if (reads || state->isAccepted)
+        threads.push_back(Thread{state, source, tags});
+    if (state->isAccepted) {
+        cut = true;
+        return;
+    }
+    for (auto &transition : state->outbounds) {
+        switch (transition->type) {
+            case Transition::Chars:
+                break;
+            case Transition::Tag:
+                tags.push_back(transition->tag);
+                taggedClosure(transition->target, source, atBegin, tags, visited, threads, cut);
+                tags.pop_back();
+                break;
+            case Transition::BeginString:
+                if (atBegin)
+                    taggedClosure(transition->target, source, atBegin, tags, visited, threads, cut);
+                break;
+            case Transition::EndString:
+                throw InterpreterException("$ is not supported with capture groups");
+            default:
+                taggedClosure(transition->target, source, atBegin, tags, visited, threads, cut);
+        }
+        if (cut)
+            return;
+    }
+}
+}
+
+/**
+ *  The minimal DFA of pattern, as the interpreters and generators consume it.
+**/
+Automaton::Ptr compileDfa(const std::string &pattern, const CompileOptions &options) {
+    // the tree is dropped as a whole once the DFA is built
+    ExpressionArena arena;
+    ExpressionArena::Scope scope(arena);
+    Range<unsigned char>::List unifiedRanges;
+    return determinize(prepare(pattern, options, unifiedRanges)->generateEpsilonNfa(), options);
+}
+
+/**
+ *  FNV-1a over the image format version, the options that shape the DFA
+ *  and the pattern text.
+**/
+uint64_t compileKey(const std::string &pattern, const CompileOptions &options) {
+    uint64_t hash = FnvOffsetBasis;
+    uint32_t version = PoorInterpreter::FormatVersion;
+    hash = fnv1a(hash, &version, sizeof(version));
+    uint8_t factorize = options.factorize;
+    hash = fnv1a(hash, &factorize, sizeof(factorize));
+    uint8_t minimization = static_cast<uint8_t>(options.minimization);
+    hash = fnv1a(hash, &minimization, sizeof(minimization));
+    uint8_t semantics = static_cast<uint8_t>(options.semantics);
+    hash = fnv1a(hash, &semantics, sizeof(semantics));
+    uint64_t length = pattern.size();
+    hash = fnv1a(hash, &length, sizeof(length));
+    return fnv1a(hash, pattern.data(), pattern.size());
+}
+
+std::string cachePath(const std::string &pattern, const CompileOptions &options) {
+    char name[24];
+    snprintf(name, sizeof(name), "%016llx.dfa", static_cast<unsigned long long>(compileKey(pattern, options)));
+    return options.cacheDirectory + "/" + name;
+}
+
+/**
+ *  Compiles pattern to a minimal DFA interpreter. With a cache directory the
+ *  serialized DFA is mapped from there when present; a missing, stale or
+ *  damaged entry is rebuilt and replaced. The file name is only a hash, so
+ *  every entry is labelled with the full pattern and options, and one
+ *  labelled otherwise counts as stale. The cache is best effort: failing to
+ *  write it never fails the compile.
+**/
+PoorInterpreter::Ptr compile(const std::string &pattern, const CompileOptions &options) {
+    if (options.cacheDirectory.empty())
+        return PoorInterpreter::Ptr(new PoorInterpreter(compileDfa(pattern, options)));
+    std::string path = cachePath(pattern, options);
+    std::string label = describe(pattern, options);
+    if (access(path.c_str(), R_OK) == 0) {
+        try {
+            auto interpreter = PoorInterpreter::load(path);
+            if (interpreter->getLabel() == label)
+                return interpreter;
+        } catch (const InterpreterException &) {
+        }
+    }
+    PoorInterpreter::Ptr interpreter(new PoorInterpreter(compileDfa(pattern, options)));
+    store(interpreter, path, label);
+    return interpreter;
+}
+
+CompileCache::CompileCache(size_t _capacity) : capacity(_capacity), statistics() {}
+
+std::string CompileCache::makeKey(const std::string &pattern, const CompileOptions &options) {
+    return describe(pattern, options);
+}
+
+PoorInterpreter::ConstPtr CompileCache::get(const std::string &pattern, const CompileOptions &options) {
+    std::string key = makeKey(pattern, options);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = index.find(key);
+        if (found != index.end()) {
+            ++statistics.hits;
+            entries.splice(entries.begin(), entries, found->second);
+            return found->second->interpreter;
+        }
+        ++statistics.misses;
+    }
+    PoorInterpreter::ConstPtr interpreter = compile(pattern, options);
+    size_t bytes = interpreter->memorySize() + key.size();
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = index.find(key);
+    if (found != index.end())
+        return found->second->interpreter;
+    if (bytes > capacity)
+        return interpreter;
+    while (statistics.bytes + bytes > capacity) {
+        Entry &victim = entries.back();
+        statistics.bytes -= victim.bytes;
+        index.erase(victim.key);
+        entries.pop_back();
+        ++statistics.evictions;
+    }
+    entries.push_front(Entry{key, interpreter, bytes});
+    index.emplace(key, entries.begin());
+    statistics.bytes += bytes;
+    return interpreter;
+}
+
+CompileCache::Statistics CompileCache::getStatistics() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    Statistics snapshot = statistics;
+    snapshot.entries = entries.size();
+    return snapshot;
+}
+
+void CompileCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.clear();
+    index.clear();
+    statistics.bytes = 0;
+}
+
+/**
+ *  A scan of the reversed input with the unanchored reverse DFA accepts at
+ *  exactly the offsets where a match starts, so one backward pass yields
+ *  the leftmost start and one forward pass from there the longest match.
+ *  With a trailing $ only the matches ending at the end of input count and
+ *  the anchored reverse DFA finds their leftmost start by reading no more
+ *  than the match itself.
+**/
+BidirectionalSearcher::BidirectionalSearcher(const std::string &pattern, const CompileOptions &options) {
+    ExpressionArena arena;
+    ExpressionArena::Scope scope(arena);
+    Range<unsigned char>::List unifiedRanges;
+    auto regex = stripEndAnchor(prepare(pattern, options, unifiedRanges), anchoredAtEnd);
+    auto nfa = regex->generateEpsilonNfa();
+    bool forwardOnly = options.semantics == Semantics::LeftmostFirst || nfa->hasAnchors();
+    forward.reset(new PoorInterpreter(determinize(nfa, options)));
+    // anchors left elsewhere and priorities do not reverse: such patterns
+    // only run forward
+    if (forwardOnly)
+        return;
+
+    nfa = regex->generateEpsilonNfa();
+    nfa->reverse();
+    reverse.reset(new PoorInterpreter(determinize(nfa, options)));
+
+    nfa = regex->generateEpsilonNfa();
+    nfa->reverse();
+    Range<unsigned char>::List alphabet = unifiedRanges;
+    marshalRange(Range<unsigned char>(0, PoorInterpreter::CharMapSize - 1), alphabet);
+    auto start = nfa->getState();
+    for (auto &range : alphabet)
+        nfa->getChars(start, start, range);
+    nfa->getEpsilon(start, nfa->startState);
+    nfa->startState = start;
+    reverseUnanchored.reset(new PoorInterpreter(determinize(nfa, options)));
+}
+
+void BidirectionalSearcher::scanForward(const char *input, size_t start, size_t end, Result *result) const {
+    int32_t state = forward->getStartState(start);
+    int32_t acceptedState = PoorInterpreter::InvalidState;
+    int32_t length = -1;
+    for (size_t reading = start; state != PoorInterpreter::InvalidState; ) {
+        if (reading == end ? forward->isAcceptedAtEnd(state) : forward->isAccepted(state)) {
+            acceptedState = state;
+            length = reading - start;
+        }
+        if (reading == end)
+            break;
+        state = forward->transit(state, input[reading++]);
+    }
+    if (result) {
+        result->start = start;
+        result->length = length;
+        result->terminateState = state;
+        result->acceptedState = acceptedState;
+    }
+}
+
+bool BidirectionalSearcher::search(const char *input, size_t length, Result *result) const {
+    if (anchoredAtEnd)
+        return searchEndingAt(input, length, result);
+    if (!reverseUnanchored) {
+        Result attempt;
+        for (size_t start = 0; start <= length && (!start || !forward->isAnchoredAtBegin()); ++start) {
+            scanForward(input, start, length, &attempt);
+            if (attempt.acceptedState != PoorInterpreter::InvalidState) {
+                if (result)
+                    *result = attempt;
+                return true;
+            }
+        }
+        return false;
+    }
+    int32_t state = reverseUnanchored->getStartState();
+    int64_t start = reverseUnanchored->isAccepted(state) ? length : -1;
+    for (size_t i = length; i-- > 0; ) {
+        state = reverseUnanchored->transit(state, input[i]);
+        if (reverseUnanchored->isAccepted(state))
+            start = i;
+    }
+    if (start < 0)
+        return false;
+    scanForward(input, start, length, result);
+    return true;
+}
+
+bool BidirectionalSearcher::searchEndingAt(const char *input, size_t end, Result *result) const {
+    if (!reverse) {
+        Result attempt;
+        for (size_t start = 0; start <= end && (!start || !forward->isAnchoredAtBegin()); ++start) {
+            scanForward(input, start, end, &attempt);
+            if (attempt.length == static_cast<int32_t>(end - start)) {
+                if (result)
+                    *result = attempt;
+                return true;
+            }
+        }
+        return false;
+    }
+    int32_t state = reverse->getStartState();
+    int64_t start = -1;
+    for (size_t i = end; state != PoorInterpreter::InvalidState; ) {
+        if (reverse->isAccepted(state))
+            start = i;
+        if (i == 0)
+            break;
+        state = reverse->transit(state, input[--i]);
+    }
+    if (start < 0)
+        return false;
+    scanForward(input, start, end, result);
+    return true;
+}
+
+TaggedInterpreter::TaggedInterpreter(const std::string &pattern, const CompileOptions &options) : onePass(true) {
+    // factorizing would not shrink the tagged DFA, and groups are numbered
+    // in the order of the pattern
+    CompileOptions tagged = options;
+    tagged.factorize = false;
+    tagged.semantics = Semantics::LeftmostFirst;
+    ExpressionArena arena;
+    ExpressionArena::Scope scope(arena);
+    Range<unsigned char>::List unifiedRanges;
+    auto regex = prepare(pattern, tagged, unifiedRanges, true);
+    groupCount = numberGroups(regex);
+    tagCount = 2 * groupCount;
+    matcher.reset(new PoorInterpreter(determinize(regex->generateEpsilonNfa(), tagged)));
+
+    Range<unsigned char>::List alphabet = unifiedRanges;
+    marshalRange(Range<unsigned char>(0, PoorInterpreter::CharMapSize - 1), alphabet);
+    charCategories = alphabet.size();
+    int16_t category = 0;
+    for (auto &range : alphabet) {
+        for (int c = range.begin; c <= range.end; ++c)
+            charMap[c] = category;
+        ++category;
+    }
+
+    // threads passing other tags make another state: the one-pass bank
+    // defers writing them until the thread reads
+    auto nfa = regex->generateEpsilonNfa(true);
+    std::vector<std::vector<Thread>> states;
+    std::map<std::vector<std::pair<State *, std::vector<int32_t>>>, int32_t> index;
+    auto intern = [&](std::vector<Thread> &threads) {
+        std::vector<std::pair<State *, std::vector<int32_t>>> key;
+        for (auto &thread : threads)
+            key.emplace_back(thread.state.get(), thread.tags);
+        auto found = index.emplace(key, states.size());
+        if (found.second)
+            states.push_back(threads);
+        return found.first->second;
+    };
+    std::vector<Thread> start, begin;
+    std::vector<int32_t> tags;
+    std::set<State *> visited;
+    bool cut = false;
+    taggedClosure(nfa->startState, -1, false, tags, visited, start, cut);
+    visited.clear();
+    cut = false;
+    taggedClosure(nfa->startState, -1, true, tags, visited, begin, cut);
+    startState = intern(start);
+    beginState = intern(begin);
+
+    // per transition, the threads of the source reading the byte and the
+    // one each thread of the target continues
+    std::vector<std::vector<int32_t>> readers, sources;
+    for (size_t state = 0; state < states.size(); ++state) {
+        for (auto &range : alphabet) {
+            std::vector<Thread> next;
+            std::vector<int32_t> reading;
+            visited.clear();
+            cut = false;
+            for (size_t i = 0; i < states[state].size() && !cut; ++i) {
+                for (auto &transition : states[state][i].state->outbounds) {
+                    if (transition->type != Transition::Chars || !transition->range.contains(range.begin))
+                        continue;
+                    if (reading.empty() || reading.back() != static_cast<int32_t>(i))
+                        reading.push_back(i);
+                    taggedClosure(transition->target, i, false, tags, visited, next, cut);
+                    if (cut)
+                        break;
+                }
+            }
+            transitions.push_back(next.empty() ? InvalidState : intern(next));
+            onePass &= reading.size() <= 1;
+            readers.push_back(reading);
+            sources.emplace_back();
+            for (auto &thread : next)
+                sources.back().push_back(thread.source);
+        }
+    }
+    stateCount = states.size();
+
+    size_t threadCount = 1;
+    for (auto &threads : states)
+        threadCount = std::max(threadCount, threads.size());
+    registerCount = onePass ? tagCount : tagCount * threadCount;
+
+    // general: thread j of the target keeps its tags in registers j*T..j*T+T-1;
+    // one-pass: the reading thread writes its tags into the only bank
+    auto take = [&](const Thread &thread, int32_t base, Operations &operations) {
+        for (int32_t tag = 0; tag < tagCount; ++tag) {
+            bool passed = std::find(thread.tags.begin(), thread.tags.end(), tag) != thread.tags.end();
+            if (passed)
+                operations.push_back(Operation{base + tag, SetPosition});
+            else if (!onePass)
+                operations.push_back(Operation{base + tag, thread.source < 0 ? Clear : thread.source * tagCount + tag});
+        }
+    };
+    if (!onePass) {
+        for (size_t j = 0; j < start.size(); ++j)
+            take(start[j], j * tagCount, startOperations);
+        for (size_t j = 0; j < begin.size(); ++j)
+            take(begin[j], j * tagCount, beginOperations);
+    }
+    transitionOperations.resize(transitions.size());
+    for (size_t slot = 0; slot < transitions.size(); ++slot) {
+        if (transitions[slot] == InvalidState)
+            continue;
+        if (onePass) {
+            const Thread &reader = states[slot / charCategories][readers[slot].front()];
+            take(reader, 0, transitionOperations[slot]);
+        } else {
+            auto threads = states[transitions[slot]];
+            for (size_t j = 0; j < threads.size(); ++j) {
+                threads[j].source = sources[slot][j];
+                take(threads[j], j * tagCount, transitionOperations[slot]);
+            }
+        }
+    }
+    acceptedBase.assign(stateCount, -1);
+    acceptOperations.resize(stateCount);
+    for (int32_t state = 0; state < stateCount; ++state) {
+        auto &threads = states[state];
+        if (threads.empty() || !threads.back().state->isAccepted)
+            continue;
+        if (onePass) {
+            acceptedBase[state] = 0;
+            take(threads.back(), 0, acceptOperations[state]);
+        } else
+            acceptedBase[state] = (threads.size() - 1) * tagCount;
+    }
+}
+
+void TaggedInterpreter::apply(const Operations &operations, const int32_t *from, int32_t *to, int32_t position) {
+    for (auto &operation : operations) {
+        if (operation.source >= 0)
+            to[operation.target] = from[operation.source];
+        else
+            to[operation.target] = operation.source == SetPosition ? position : -1;
+    }
+}
+
+bool TaggedInterpreter::searchHead(const char *input, Captures &captures, uint32_t offset) const {
+    std::vector<int32_t> registers(onePass ? registerCount : 2 * registerCount, -1);
+    std::vector<int32_t> accepted(tagCount, -1);
+    int32_t *current = registers.data(), *next = current + (onePass ? 0 : registerCount);
+    int32_t state = offset ? startState : beginState;
+    apply(offset ? startOperations : beginOperations, current, current, offset);
+    int64_t end = -1;
+    for (int32_t position = offset; ; ++position) {
+        int32_t base = acceptedBase[state];
+        if (base >= 0) {
+            std::copy(current + base, current + base + tagCount, accepted.begin());
+            apply(acceptOperations[state], current, accepted.data(), position);
+            end = position;
+        }
+        unsigned char c = input[position];
+        if (!c)
+            break;
+        size_t slot = static_cast<size_t>(state) * charCategories + charMap[c];
+        state = transitions[slot];
+        if (state == InvalidState)
+            break;
+        if (onePass)
+            apply(transitionOperations[slot], current, current, position);
+        else {
+            apply(transitionOperations[slot], current, next, position + 1);
+            std::swap(current, next);
+        }
+    }
+    if (end < 0)
+        return false;
+    captures.assign(groupCount + 1, Capture{-1, -1});
+    captures[0] = Capture{static_cast<int32_t>(offset), static_cast<int32_t>(end - offset)};
+    for (int32_t group = 0; group < groupCount; ++group) {
+        int32_t open = accepted[2 * group], close = accepted[2 * group + 1];
+        if (open >= 0 && close >= open)
+            captures[group + 1] = Capture{open, close - open};
+    }
+    return true;
+}
+
+// the table DFA finds the leftmost start, the tagged one the groups from there
+bool TaggedInterpreter::search(const char *input, Captures &captures, uint32_t offset) const {
+    PoorInterpreter::Result result;
+    if (!matcher->search(input, &result, offset))
+        return false;
+    return searchHead(input, captures, result.start);
+}
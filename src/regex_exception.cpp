@@ -5,3 +5,9 @@ LexerException::LexerException(const std::string m) : message(m) {}
 const char *LexerException::what() const noexcept {
     return message.c_str();
 }
+
+InterpreterException::InterpreterException(const std::string m) : message(m) {}
+
+const char *InterpreterException::what() const noexcept {
+    return message.c_str();
+}
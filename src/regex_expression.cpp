@@ -1,70 +1,91 @@
+#include <algorithm>
+#include <cstddef>
 #include <sstream>
+#include <stdexcept>
 #include <iostream>
 #include "regex_expression.h"
 #include "regex_exception.h"
 #include "regex_algorithm.h"
 
-bool Expression::equals(Expression *target) {
-    return EqualsVisitor().invoke(this, target);
+constexpr size_t ExpressionArena::ChunkSize;
+
+ExpressionArena::ExpressionArena() : cursor(nullptr), left(0), used(0) {
 }
 
-void Expression::graphviz(std::ostream &os) {
-    os << "digraph {\n";
-    GraphvizVisitor(os).invoke(this, nullptr);
-    os << "}" << std::endl;
+void *ExpressionArena::allocate(size_t size) {
+    const size_t alignment = alignof(std::max_align_t);
+    size = (size + alignment - 1) & ~(alignment - 1);
+    if (size > left) {
+        size_t chunk = std::max(size, ChunkSize);
+        chunks.emplace_back(new char[chunk]);
+        cursor = chunks.back().get();
+        left = chunk;
+    }
+    void *memory = cursor;
+    cursor += size;
+    left -= size;
+    used += size;
+    return memory;
 }
 
-void Expression::setNormalize(Range<unsigned char>::List *unifiedRanges) {
-    SetNormalizationVisitor().invoke(this, unifiedRanges);
+namespace {
+thread_local ExpressionArena *activeArena = nullptr;
 }
 
-void Expression::setUnify(Range<unsigned char>::List unifiedRanges) {
-    SetUnificationVisitor().invoke(this, &unifiedRanges);
+ExpressionArena &ExpressionArena::current() {
+    if (!activeArena)
+        throw std::logic_error("expression built with no ExpressionArena in scope");
+    return *activeArena;
 }
 
-Automaton::Ptr Expression::generateEpsilonNfa() {
-    Automaton::Ptr automaton(new Automaton);
-    EpsilonNfa nfa = EpsilonNfaVisitor().invoke(this, automaton.get());
-    automaton->startState = nfa.start;
-    nfa.finish->isAccepted = true;
-    return automaton;
+ExpressionArena::Scope::Scope(ExpressionArena &arena) : saved(activeArena) {
+    activeArena = &arena;
 }
 
-CharRangeExpression::CharRangeExpression() : range('\x00', '\x00') {
+ExpressionArena::Scope::~Scope() {
+    activeArena = saved;
 }
 
-CharRangeExpression::CharRangeExpression(unsigned char b,unsigned char e) : range(b, e) {
+void *Expression::operator new(size_t size) {
+    return ExpressionArena::current().allocate(size);
 }
 
-void CharRangeExpression::accept(Visitor &visitor) {
-    visitor.visit(this);
+bool Expression::equals(Expression *target) {
+    return this == target || EqualsVisitor().equals(this, target);
+}
+
+void Expression::graphviz(std::ostream &os) {
+    os << "digraph {\n";
+    GraphvizVisitor(os).invoke(this, nullptr);
+    os << "}" << std::endl;
 }
 
-void BeginExpression::accept(Visitor &visitor) {
-    visitor.visit(this);
+void Expression::setNormalize(Range<unsigned char>::List *unifiedRanges) {
+    SetNormalizationVisitor().normalize(this, unifiedRanges);
 }
 
-void EndExpression::accept(Visitor &visitor) {
-    visitor.visit(this);
+void Expression::setUnify(Range<unsigned char>::List unifiedRanges) {
+    SetUnificationVisitor().normalize(this, &unifiedRanges);
 }
 
-RepeatExpression::RepeatExpression(int32_t min, int32_t max, bool gdy) : times(min, max), isGreedy(gdy) {
+Automaton::Ptr Expression::generateEpsilonNfa(bool tagged) {
+    Automaton::Ptr automaton(new Automaton);
+    EpsilonNfa nfa = EpsilonNfaVisitor(tagged).build(this, automaton.get());
+    automaton->startState = nfa.start;
+    nfa.finish->isAccepted = true;
+    return automaton;
 }
 
-void RepeatExpression::accept(Visitor &visitor) {
-    visitor.visit(this);
+CharRangeExpression::CharRangeExpression() : Expression(Tag), range('\x00', '\x00') {
 }
 
-void SetExpression::accept(Visitor &visitor) {
-    visitor.visit(this);
+CharRangeExpression::CharRangeExpression(unsigned char b,unsigned char e) : Expression(Tag), range(b, e) {
 }
 
-void ConcatenationExpression::accept(Visitor &visitor) {
-    visitor.visit(this);
+RepeatExpression::RepeatExpression(int32_t min, int32_t max, bool gdy) : Expression(Tag), times(min, max), isGreedy(gdy) {
 }
 
-void SelectExpression::accept(Visitor &visitor) {
-    visitor.visit(this);
+GroupExpression::GroupExpression(int32_t idx) : Expression(Tag), index(idx) {
 }
 
 bool isChar(const char *&input, char c) {
@@ -99,12 +120,13 @@ char parseChar(const char *&input) {
                 c = '\t';
                 break;
             case '-': case '[': case ']': case '\\': case '/': case '^': case '$': case '.': case '+': case '*': case '?': case '|':
+            case '{': case '}':
                 c = *input;
                 break;
             default:
             {
                 std::ostringstream msg("Illegal character escapoing: ", std::ostringstream::ate);
-                msg << repr(*input) << "(Only \"rnt-[]\\/^$.+*?|\" are legal escaped characters)";
+                msg << repr(*input) << "(Only \"rnt-[]\\/^$.+*?|{}\" are legal escaped characters)";
                 throw LexerException(msg.str());
             }
         }
@@ -135,16 +157,10 @@ Expression::Ptr parseSetItem(const char *&input) {
  *  <SetItems> ::= <SetItem> | <SetItem> <SetItems>
 **/
 Expression::Ptr parseSetItems(const char *&input) {
-    if (!*input || *input == ']')
-        return nullptr;
-    Expression::Ptr setItem = parseSetItem(input), right = parseSetItems(input);
-    if (right) {
-        SelectExpression *select = new SelectExpression;
-        select->left = setItem;
-        select->right = right;
-        return Expression::Ptr(select);
-    } else
-        return setItem;
+    std::vector<Expression::Ptr> items;
+    while (*input && *input != ']')
+        items.emplace_back(parseSetItem(input));
+    return alternate(items);
 }
 
 /**
@@ -162,7 +178,6 @@ Expression::Ptr parseSetItems(const char *&input) {
  *  <range> ::= <char> "-" <char>
 **/
 Expression::Ptr parseElementaryRE(const char *&input) {
-    using std::shared_ptr;
     if (!*input)
         return nullptr;
     else if (isChar(input, '^'))    // <bos>
@@ -172,14 +187,15 @@ Expression::Ptr parseElementaryRE(const char *&input) {
     else if (isChar(input, '.'))    // <any>
         return Expression::Ptr(new CharRangeExpression('\x01', '\xFF'));
     else if (isChar(input, '[')) {  // <set>
-        shared_ptr<SetExpression> expr(new SetExpression);
+        SetExpression *expr = new SetExpression;
         expr->isComplementary = isChar(input, '^');
         expr->expression = parseSetItems(input);
         if (!isChar(input, ']'))
             throw LexerException("Expect a ']' to close a <set>");
         return expr;
     } else if (isChar(input, '(')) { // <group>
-        Expression::Ptr expr = parseRE(input);
+        GroupExpression *expr = new GroupExpression;
+        expr->expression = parseRE(input);
         if (!isChar(input, ')'))
             throw LexerException("Expect a ')' to close a <group>");
         return expr;
@@ -192,78 +208,205 @@ Expression::Ptr parseElementaryRE(const char *&input) {
     }
 }
 
+static bool parseCount(const char *&input, int32_t &count) {
+    if (*input < '0' || *input > '9')
+        return false;
+    int64_t value = 0;
+    while (*input >= '0' && *input <= '9') {
+        value = value * 10 + (*input++ - '0');
+        if (value > MaxRepetition) {
+            std::ostringstream msg("Repetition count over ", std::ostringstream::ate);
+            msg << MaxRepetition;
+            throw LexerException(msg.str());
+        }
+    }
+    count = value;
+    return true;
+}
+
 /**
- * <basicRE> :== <star> | <plus> | <question> | <ElementaryRE>
+ *  <count-range> ::= "{" <count> "}" | "{" <count> ",}" | "{" <count> "," <count> "}"
+ *  Anything else after "{" leaves it to be read as a <char>.
+**/
+static bool parseCounted(const char *&input, int32_t &min, int32_t &max) {
+    const char *start = input;
+    if (isChar(input, '{') && parseCount(input, min)) {
+        max = min;
+        if (isChar(input, ','))
+            max = parseCount(input, max) ? max : -1;
+        if (isChar(input, '}')) {
+            if (max != -1 && min > max) {
+                std::ostringstream msg("Repetition out of order: {", std::ostringstream::ate);
+                msg << min << "," << max << "}";
+                throw LexerException(msg.str());
+            }
+            return true;
+        }
+    }
+    input = start;
+    return false;
+}
+
+// the quantifiers, if any, after an <ElementaryRE>; stacked ones nest, so a{2}{3} is (a{2}){3}
+static Expression::Ptr parseQuantifier(const char *&input, Expression::Ptr elementary) {
+    while (true) {
+        int32_t min, max;
+        if (elementary && parseCounted(input, min, max)) {  // <counted>
+        } else if (isChar(input, '*')) {   // <star>
+            min = 0, max = -1;
+        } else if (isChar(input, '+')) {    // <plus>
+            min = 1, max = -1;
+        } else if (isChar(input, '?')) {    // <question>
+            min = 0, max = 1;
+        } else {
+            return elementary;
+        }
+        RepeatExpression *repeat = new RepeatExpression(min, max, !isChar(input, '?'));
+        repeat->expression = elementary;
+        elementary = Expression::Ptr(repeat);
+    }
+}
+
+/**
+ * <basicRE> :== <star> | <plus> | <question> | <counted> | <ElementaryRE>
+ * (the quantified element may itself be a <basicRE>)
  * <star> ::= <ElementaryRE> "*" | <ElementaryRE> "*?"
  * <plus> ::= <ElementaryRE> "+" | <ElementaryRE> "+?"
  * <question> ::= <ElementaryRE> "?" | <ElementaryRE> "??"
+ * <counted> ::= <ElementaryRE> <count-range> | <ElementaryRE> <count-range> "?"
 **/
 Expression::Ptr parseBasicRE(const char *&input) {
     Expression::Ptr elementary = parseElementaryRE(input);
-    if (isChar(input, '*')) {   // <star>
-        RepeatExpression *repeat = new RepeatExpression(0, -1, !isChar(input, '?'));
-        repeat->expression = elementary;
-        return Expression::Ptr(repeat);
-    } else if (isChar(input, '+')) {    // <plus>
-        RepeatExpression *repeat = new RepeatExpression(1, -1, !isChar(input, '?'));
-        repeat->expression = elementary;
-        return Expression::Ptr(repeat);
-    } else if (isChar(input, '?')) {    // <question>
-        RepeatExpression *repeat = new RepeatExpression(0, 1, !isChar(input, '?'));
-        repeat->expression = elementary;
-        return Expression::Ptr(repeat);
-    } else {
-        return elementary;
-    }
+    return parseQuantifier(input, elementary);
 }
 
 /**
- * <SimpleRE> ::= <SimpleRE-1> <BasicRE>
- * <SimpleRE-1> ::= <BasicRE> <SimpleRE-1> | epsilon
+ * <SimpleRE> ::= <BasicRE> | <BasicRE> <SimpleRE>
 **/
 Expression::Ptr parseSimpleRE(const char *&input) {
-    if (!*input)
-        return nullptr;
-    Expression::Ptr basic = parseBasicRE(input);
-    if (!basic)
-        return nullptr;
-    Expression::Ptr right = parseSimpleRE(input);
-    if (right) {
-        ConcatenationExpression *concatenation = new ConcatenationExpression;
-        concatenation->left = basic;
-        concatenation->right = right;
-        return Expression::Ptr(concatenation);
-    } else
-        return basic;
+    std::vector<Expression::Ptr> items;
+    while (*input) {
+        Expression::Ptr basic = parseBasicRE(input);
+        if (!basic)
+            break;
+        items.emplace_back(basic);
+    }
+    return concatenate(items);
 }
 
 /**
- * <RE> ::= <RE-1> <SimpleRE>
- * <RE-1> ::= "|" <SimpleRE> <RE-1> | epsilon
+ * <RE> ::= <SimpleRE> | <SimpleRE> "|" <RE>
+ * Groups open and close on a stack of levels instead of recursing, so
+ * neither their nesting nor the length of a pattern is bounded by the
+ * native stack. A level gathers its alternatives and the items of the
+ * current one into n-ary nodes; an empty alternative at the end is
+ * dropped.
 **/
 Expression::Ptr parseRE(const char *&input) {
-    if (!*input)
-        return nullptr;
-    Expression::Ptr simple = parseSimpleRE(input);
-    if (isChar(input, '|')) {
-        Expression::Ptr right = parseRE(input);
-        if (right) {
-            SelectExpression *select = new SelectExpression;
-            select->left = simple;
-            select->right = right;
-            return Expression::Ptr(select);
+    struct Level {
+        std::vector<Expression::Ptr> alternatives;
+        std::vector<Expression::Ptr> items;
+    };
+    std::vector<Level> levels(1);
+    while (true) {
+        Level &level = levels.back();
+        if (*input && *input != '|' && *input != ')') {
+            if (isChar(input, '('))  // <group>
+                levels.emplace_back();
+            else
+                level.items.emplace_back(parseBasicRE(input));
+            continue;
         }
+        level.alternatives.emplace_back(concatenate(level.items));
+        level.items.clear();
+        if (isChar(input, '|'))
+            continue;
+        while (!level.alternatives.empty() && !level.alternatives.back())
+            level.alternatives.pop_back();
+        Expression::Ptr expression = alternate(level.alternatives);
+        if (levels.size() == 1)
+            return expression;
+        if (!isChar(input, ')'))
+            throw LexerException("Expect a ')' to close a <group>");
+        levels.pop_back();
+        GroupExpression *group = new GroupExpression;
+        group->expression = expression;
+        levels.back().items.emplace_back(parseQuantifier(input, group));
     }
-    return simple;
 }
 
 Expression::Ptr parseRegex(const std::string &str) {
     const char *input = str.c_str(), *start = input;
     try {
-        return parseRE(input);
+        Expression::Ptr expression = parseRE(input);
+        numberGroups(expression);
+        return expression;
     } catch (LexerException e) {
         std::ostringstream os(e.what(), std::ostringstream::ate);
         os << " in position " << input-start << " of \"" << repr(str) << "\"";
         throw LexerException(os.str());
     }
 }
+
+/**
+ *  Builds the n-ary nodes: items of the same kind are spliced in, and
+ *  fewer than two items leave no node. Empty items of a concatenation go,
+ *  those of a select are empty alternatives.
+**/
+Expression::Ptr concatenate(const std::vector<Expression::Ptr> &items) {
+    std::vector<Expression::Ptr> flat;
+    for (auto item : items) {
+        ConcatenationExpression *concatenation = expressionCast<ConcatenationExpression>(item);
+        if (concatenation)
+            flat.insert(flat.end(), concatenation->items.begin(), concatenation->items.end());
+        else if (item)
+            flat.emplace_back(item);
+    }
+    if (flat.size() < 2)
+        return flat.empty() ? nullptr : flat.front();
+    ConcatenationExpression *concatenation = new ConcatenationExpression;
+    concatenation->items = ExpressionList(flat.begin(), flat.end());
+    return concatenation;
+}
+
+Expression::Ptr alternate(const std::vector<Expression::Ptr> &alternatives) {
+    std::vector<Expression::Ptr> flat;
+    for (auto alternative : alternatives) {
+        SelectExpression *select = expressionCast<SelectExpression>(alternative);
+        if (select)
+            flat.insert(flat.end(), select->items.begin(), select->items.end());
+        else
+            flat.emplace_back(alternative);
+    }
+    if (flat.size() < 2)
+        return flat.empty() ? nullptr : flat.front();
+    SelectExpression *select = new SelectExpression;
+    select->items = ExpressionList(flat.begin(), flat.end());
+    return select;
+}
+
+/**
+ *  numbers the groups from 1 in the order of their opening parentheses
+ *  and returns how many there are
+**/
+int32_t numberGroups(Expression::Ptr expression) {
+    return GroupNumberingVisitor().number(expression);
+}
+
+Expression::Ptr simplify(Expression::Ptr expression, bool keepGroups, SimplificationStatistics *statistics) {
+    if (!expression)
+        return expression;
+    expression = InterningVisitor().intern(expression);
+    SimplificationVisitor visitor(keepGroups, statistics);
+    do {
+        visitor.resetChanges();
+        expression = visitor.invoke(expression, nullptr);
+    } while (visitor.getChanges());
+    return expression;
+}
+
+Expression::Ptr factorize(Expression::Ptr expression) {
+    if (!expression)
+        return expression;
+    return FactorizationVisitor().invoke(expression, nullptr);
+}
@@ -1,86 +1,616 @@
 #include <algorithm>
 #include <unordered_map>
 #include <cstring>
-#include <stack>
 #include <iostream>
+#include <thread>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "regex_interpreter.h"
+#include "regex_exception.h"
 #include "utility.h"
 
 constexpr int PoorInterpreter::CharMapSize;
 constexpr int PoorInterpreter::InvalidState;
+constexpr int PoorInterpreter::BatchWidth;
+constexpr uint32_t PoorInterpreter::FormatVersion;
+constexpr uint32_t PoorInterpreter::AnchoredAtBegin;
+
+namespace {
+const char ImageMagic[8] = {'T', 'O', 'Y', 'D', 'F', 'A', '\0', '\0'};
+constexpr uint32_t ImageByteOrder = 0x01020304;
+
+uint64_t alignImage(uint64_t offset) {
+    return (offset + 7) & ~uint64_t(7);
+}
+}
 
 PoorInterpreter::PoorInterpreter(Automaton::Ptr dfa) {
     Range<unsigned char>::List ranges;
     for (auto transition : dfa->transitions) {
         marshalRange(transition->range, ranges);
     }
-    stateCount = dfa->states.size();
-    acceptedStates.resize(stateCount);
     std::unordered_map<State::Ptr, int32_t> stateMap;
     int32_t index = 0;
     for (auto state : dfa->states) {
-        acceptedStates[index] = state->isAccepted;
         stateMap.emplace(state, index++);
     }
-    charCategories = ranges.size() + 1;
-    charMap.resize(CharMapSize, charCategories-1);
-    startState = stateMap[dfa->startState];
+    ImageHeader header;
+    memcpy(header.magic, ImageMagic, sizeof(header.magic));
+    header.version = FormatVersion;
+    header.byteOrder = ImageByteOrder;
+    header.stateCount = dfa->states.size();
+    header.charCategories = ranges.size() + 1;
+    header.startState = stateMap[dfa->startState];
+    header.beginState = stateMap[dfa->beginState ? dfa->beginState : dfa->startState];
+    header.flags = 0;
+    header.reserved = 0;
+    header.labelSize = 0;
+    layout(header);
+
+    char *buffer = new char[header.size]();
+    image.reset(buffer, std::default_delete<char[]>());
+    memcpy(buffer, &header, sizeof(header));
+    int16_t *chars = reinterpret_cast<int16_t *>(buffer + header.charMapOffset);
+    int32_t *table = reinterpret_cast<int32_t *>(buffer + header.transitionOffset);
+    uint8_t *accepted = reinterpret_cast<uint8_t *>(buffer + header.acceptedOffset);
+    uint8_t *atEnd = reinterpret_cast<uint8_t *>(buffer + header.acceptedAtEndOffset);
+    std::fill(chars, chars + CharMapSize, header.charCategories - 1);
     auto iter = ranges.begin();
     for (size_t i = 0, iend = ranges.size(); i != iend; ++i, ++iter) {
         for (size_t j = iter->begin, jend = iter->end; j <= jend; ++j) {
-            charMap[j] = i;
+            chars[j] = i;
         }
     }
-    transitionTable.resize(stateCount, std::vector<int32_t>(charCategories, InvalidState));
+    std::fill(table, table + header.stateCount * header.charCategories, InvalidState);
+    std::vector<std::pair<int32_t, int32_t>> endTransitions;
     auto stateIter = dfa->states.begin();
-    for (size_t i = 0; i < stateCount; ++i, ++stateIter) {
+    for (int32_t i = 0; i < header.stateCount; ++i, ++stateIter) {
+        accepted[i] = atEnd[i] = (*stateIter)->isAccepted;
         for (auto transition : (*stateIter)->outbounds) {
             switch (transition->type) {
                 case Transition::Chars:
                     iter = ranges.begin();
                     for (size_t j = 0, jend = ranges.size(); j != jend; ++j, ++iter) {
                         if (transition->range.begin <= iter->begin && transition->range.end >= iter->end)
-                            transitionTable[i][j] = stateMap[transition->target];
+                            table[i * header.charCategories + j] = stateMap[transition->target];
                     }
                     break;
+                case Transition::EndString:
+                    endTransitions.emplace_back(i, stateMap[transition->target]);
+                    break;
                 default:
                     assertm(0, "Poor Interpreter should not have non-chars transition");
             }
         }
     }
+    // $ may be followed by more of them, but never by a byte
+    for (bool changed = true; changed; ) {
+        changed = false;
+        for (auto &transition : endTransitions) {
+            if (atEnd[transition.second] && !atEnd[transition.first]) {
+                atEnd[transition.first] = 1;
+                changed = true;
+            }
+        }
+    }
+    std::vector<bool> reached(header.stateCount);
+    std::vector<int32_t> statesQ(1, header.startState);
+    reached[header.startState] = true;
+    bool live = false;
+    while (!statesQ.empty() && !live) {
+        int32_t state = statesQ.back();
+        statesQ.pop_back();
+        live = atEnd[state];
+        for (int32_t j = 0; j < header.charCategories; ++j) {
+            int32_t target = table[state * header.charCategories + j];
+            if (target != InvalidState && !reached[target]) {
+                reached[target] = true;
+                statesQ.push_back(target);
+            }
+        }
+    }
+    if (!live)
+        reinterpret_cast<ImageHeader *>(buffer)->flags |= AnchoredAtBegin;
+    bind();
 }
 
-bool PoorInterpreter::match(const char *input) {
+PoorInterpreter::PoorInterpreter(std::shared_ptr<const char> image) : image(image) {
+    bind();
+}
+
+void PoorInterpreter::layout(ImageHeader &header) {
+    header.charMapOffset = alignImage(sizeof(ImageHeader));
+    header.transitionOffset = alignImage(header.charMapOffset + CharMapSize * sizeof(int16_t));
+    header.acceptedOffset = alignImage(header.transitionOffset
+            + uint64_t(header.stateCount) * header.charCategories * sizeof(int32_t));
+    header.acceptedAtEndOffset = alignImage(header.acceptedOffset + header.stateCount);
+    header.labelOffset = alignImage(header.acceptedAtEndOffset + header.stateCount);
+    header.size = alignImage(header.labelOffset + header.labelSize);
+}
+
+void PoorInterpreter::bind() {
+    const ImageHeader *header = reinterpret_cast<const ImageHeader *>(image.get());
+    stateCount = header->stateCount;
+    charCategories = header->charCategories;
+    startState = header->startState;
+    beginState = header->beginState;
+    anchoredAtBegin = header->flags & AnchoredAtBegin;
+    charMap = reinterpret_cast<const int16_t *>(image.get() + header->charMapOffset);
+    transitionTable = reinterpret_cast<const int32_t *>(image.get() + header->transitionOffset);
+    acceptedStates = reinterpret_cast<const uint8_t *>(image.get() + header->acceptedOffset);
+    acceptedAtEnd = reinterpret_cast<const uint8_t *>(image.get() + header->acceptedAtEndOffset);
+}
+
+void PoorInterpreter::save(std::ostream &os, const std::string &label) const {
+    const ImageHeader *current = reinterpret_cast<const ImageHeader *>(image.get());
+    ImageHeader header = *current;
+    header.labelSize = label.size();
+    layout(header);
+    os.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    os.write(image.get() + sizeof(header), header.labelOffset - sizeof(header));
+    os.write(label.data(), label.size());
+    const char padding[8] = {};
+    os.write(padding, header.size - header.labelOffset - label.size());
+}
+
+/**
+ *  Maps a file written by save() read-only and shared, so every process
+ *  loading the same file runs on the same physical pages. The image is
+ *  checked before use but never copied.
+**/
+PoorInterpreter::Ptr PoorInterpreter::load(const std::string &path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw InterpreterException("cannot open " + path);
+    struct stat info;
+    if (fstat(fd, &info) < 0 || info.st_size < static_cast<off_t>(sizeof(ImageHeader))) {
+        close(fd);
+        throw InterpreterException(path + " is not a compiled DFA");
+    }
+    size_t size = info.st_size;
+    void *mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+        throw InterpreterException("cannot map " + path);
+    std::shared_ptr<const char> image(static_cast<const char *>(mapping), [size](const char *p) {
+        munmap(const_cast<char *>(p), size);
+    });
+
+    ImageHeader header = *reinterpret_cast<const ImageHeader *>(image.get());
+    if (memcmp(header.magic, ImageMagic, sizeof(header.magic)) != 0)
+        throw InterpreterException(path + " is not a compiled DFA");
+    if (header.version != FormatVersion)
+        throw InterpreterException(path + " has unsupported format version " + std::to_string(header.version));
+    if (header.byteOrder != ImageByteOrder)
+        throw InterpreterException(path + " was written with a different byte order");
+    if (header.stateCount <= 0 || header.charCategories <= 0 || header.charCategories > CharMapSize + 1
+            || header.startState < 0 || header.startState >= header.stateCount
+            || header.beginState < 0 || header.beginState >= header.stateCount || (header.flags & ~AnchoredAtBegin))
+        throw InterpreterException(path + " has a corrupt header");
+    ImageHeader expected = header;
+    if (header.labelSize > size)
+        throw InterpreterException(path + " has a corrupt layout");
+    layout(expected);
+    if (header.charMapOffset != expected.charMapOffset || header.transitionOffset != expected.transitionOffset
+            || header.acceptedOffset != expected.acceptedOffset
+            || header.acceptedAtEndOffset != expected.acceptedAtEndOffset
+            || header.labelOffset != expected.labelOffset || header.size != expected.size || header.size != size)
+        throw InterpreterException(path + " has a corrupt layout");
+
+    // every table entry is an index, so a bad one would read out of bounds
+    const int16_t *chars = reinterpret_cast<const int16_t *>(image.get() + header.charMapOffset);
+    for (int i = 0; i < CharMapSize; ++i) {
+        if (chars[i] < 0 || chars[i] >= header.charCategories)
+            throw InterpreterException(path + " has a corrupt byte-class map");
+    }
+    const int32_t *table = reinterpret_cast<const int32_t *>(image.get() + header.transitionOffset);
+    for (int64_t i = 0, iend = int64_t(header.stateCount) * header.charCategories; i != iend; ++i) {
+        if (table[i] < InvalidState || table[i] >= header.stateCount)
+            throw InterpreterException(path + " has a corrupt transition table");
+    }
+    const uint8_t *accepted = reinterpret_cast<const uint8_t *>(image.get() + header.acceptedOffset);
+    const uint8_t *atEnd = reinterpret_cast<const uint8_t *>(image.get() + header.acceptedAtEndOffset);
+    for (int32_t i = 0; i < header.stateCount; ++i) {
+        if (accepted[i] > 1 || atEnd[i] > 1 || accepted[i] > atEnd[i])
+            throw InterpreterException(path + " has a corrupt accept table");
+    }
+    return Ptr(new PoorInterpreter(image));
+}
+
+bool PoorInterpreter::match(const char *input) const {
     Result result;
     return searchHead(input, &result, 0) && result.length == strlen(input);
 }
 
-bool PoorInterpreter::search(const char *input, Result *result, uint32_t offset) {
-    if (offset > strlen(input))
+bool PoorInterpreter::search(const char *input, Result *result, uint32_t offset) const {
+    size_t length = strlen(input);
+    if (offset > length)
         return false;
     do {
         if (searchHead(input, result, offset++))
             return true;
-    } while (input[offset]);
+    } while (offset < length && !anchoredAtBegin);
+    return false;
+}
+
+/**
+ *  Reports every non-empty leftmost-longest match, resuming right after
+ *  each one. The input is read once: attempts at every offset run side by
+ *  side in a StreamMatcher rather than being restarted one after another.
+**/
+size_t PoorInterpreter::searchAll(const char *input, Callback callback) const {
+    StreamMatcher matcher(*this, false);
+    size_t count = 0;
+    Result result;
+    auto report = [&]() {
+        for (auto &match : matcher.ready) {
+            result.start = match.start;
+            result.length = match.length;
+            result.terminateState = match.terminateState;
+            result.acceptedState = match.acceptedState;
+            callback(result);
+        }
+        count += matcher.ready.size();
+        matcher.ready.clear();
+    };
+    for (const char *reading = input, *end = input + strlen(input); reading != end; ) {
+        size_t skipped = matcher.skip(reading, end - reading);
+        reading += skipped;
+        if (!skipped)
+            matcher.step(*reading++);
+        if (!matcher.ready.empty())
+            report();
+    }
+    matcher.end();
+    report();
+    return count;
+}
+
+/**
+ *  search over a string column stored as one data buffer plus rows+1
+ *  offsets (Arrow layout). Bit i of bitmap (least significant bit first)
+ *  is set when row i contains a match, and spans[i], when given, receives
+ *  the leftmost-longest match with start relative to the row; a row
+ *  without one gets start 0, length -1 and InvalidState for both states.
+ *  Each row is read once, with attempts at every offset side by side.
+**/
+template <typename Offset>
+size_t PoorInterpreter::scanColumn(const char *data, const Offset *offsets, size_t rows, uint8_t *bitmap, Result *spans) const {
+    StreamMatcher matcher(*this, true);
+    size_t count = 0;
+    memset(bitmap, 0, (rows + 7) / 8);
+    for (size_t i = 0; i < rows; ++i) {
+        const char *row = data + offsets[i];
+        size_t length = offsets[i+1] - offsets[i];
+        matcher.reset();
+        for (size_t reading = 0; reading < length && matcher.ready.empty(); ) {
+            size_t skipped = matcher.skip(row + reading, length - reading);
+            reading += skipped;
+            if (!skipped)
+                matcher.step(row[reading++]);
+        }
+        if (matcher.ready.empty())
+            matcher.end();
+        Result *span = spans ? spans + i : nullptr;
+        if (!matcher.ready.empty()) {
+            const StreamMatcher::Match &match = matcher.ready.front();
+            bitmap[i >> 3] |= 1 << (i & 7);
+            ++count;
+            if (span) {
+                span->start = match.start;
+                span->length = match.length;
+                span->terminateState = match.terminateState;
+                span->acceptedState = match.acceptedState;
+            }
+        } else if (span) {
+            span->start = 0;
+            span->length = -1;
+            span->terminateState = span->acceptedState = InvalidState;
+        }
+    }
+    return count;
+}
+
+size_t PoorInterpreter::searchColumn(const char *data, const int32_t *offsets, size_t rows, uint8_t *bitmap, Result *spans) const {
+    return scanColumn<int32_t>(data, offsets, rows, bitmap, spans);
+}
+
+size_t PoorInterpreter::searchColumn(const char *data, const int64_t *offsets, size_t rows, uint8_t *bitmap, Result *spans) const {
+    return scanColumn<int64_t>(data, offsets, rows, bitmap, spans);
 }
 
-bool PoorInterpreter::searchHead(const char *input, Result *result, uint32_t offset) {
+/**
+ *  searchHead over many independent inputs. Up to BatchWidth inputs advance
+ *  in lockstep so that their table lookups, which only depend on their own
+ *  previous lookup, overlap in the memory pipeline; with prefetch the row
+ *  of every lane's next state is requested one step ahead.
+**/
+void PoorInterpreter::searchHeadBatch(const char *const *inputs, size_t count, Result *results, bool prefetch) const {
+    const int32_t *table = transitionTable;
+    const int16_t *chars = charMap;
+    for (size_t base = 0; base < count; base += BatchWidth) {
+        size_t lanes = std::min<size_t>(BatchWidth, count - base);
+        const unsigned char *reading[BatchWidth];
+        int32_t states[BatchWidth];
+        size_t alive = 0;
+        for (size_t i = 0; i < lanes; ++i) {
+            Result &result = results[base + i];
+            reading[i] = reinterpret_cast<const unsigned char *>(inputs[base + i]);
+            states[i] = beginState;
+            result.start = 0;
+            result.length = -1;
+            result.acceptedState = InvalidState;
+            ++alive;
+        }
+        int32_t length = 0;
+        while (alive) {
+            for (size_t i = 0; i < lanes; ++i) {
+                int32_t state = states[i];
+                if (state == InvalidState)
+                    continue;
+                Result &result = results[base + i];
+                unsigned char c = reading[i][length];
+                if (c ? acceptedStates[state] : acceptedAtEnd[state]) {
+                    result.acceptedState = state;
+                    result.length = length;
+                }
+                state = c ? table[state * charCategories + chars[c]] : InvalidState;
+                if (state == InvalidState) {
+                    result.terminateState = c ? InvalidState : states[i];
+                    --alive;
+#ifdef __GNUC__
+                } else if (prefetch) {
+                    __builtin_prefetch(table + state * charCategories);
+#endif
+                }
+                states[i] = state;
+            }
+            ++length;
+        }
+    }
+}
+
+/**
+ *  Same matches as searchAll, with the input split into one chunk per
+ *  thread. Every chunk runs its own StreamMatcher as if the serial scan had
+ *  resumed at its first byte, reading past its end only until the attempts
+ *  started inside it are over. The chunks are then stitched in order: when
+ *  the serial scan resumes inside one of a chunk's speculative matches, a
+ *  StreamMatcher replays it from there until it resumes at an offset the
+ *  speculative scan attempted as well, after which both agree. Results
+ *  hold 32-bit offsets, so longer inputs are rejected.
+**/
+size_t PoorInterpreter::parallelSearchAll(const char *input, unsigned threads, Callback callback) const {
+    size_t length = strlen(input);
+    if (length > size_t(INT32_MAX))
+        throw InterpreterException("input of " + std::to_string(length) + " bytes is too long for parallelSearchAll");
+    if (threads < 2 || length < threads || anchoredAtBegin)
+        return searchAll(input, callback);
+    struct Chunk {
+        size_t begin;
+        size_t end;
+        std::vector<Result> results;
+    };
+    std::vector<Chunk> chunks(threads);
+    for (unsigned i = 0; i < threads; ++i) {
+        chunks[i].begin = length * i / threads;
+        chunks[i].end = length * (i + 1) / threads;
+    }
+    // hands take the matches starting before limit; true once take returns false
+    auto run = [input, length](StreamMatcher &matcher, size_t limit, const std::function<bool(const Result &)> &take) {
+        for (;;) {
+            bool over = matcher.offset == length;
+            if (over)
+                matcher.end();
+            for (auto &match : matcher.ready) {
+                if (match.start >= limit)
+                    return false;
+                Result result;
+                result.start = match.start;
+                result.length = match.length;
+                result.terminateState = match.terminateState;
+                result.acceptedState = match.acceptedState;
+                if (!take(result))
+                    return true;
+            }
+            matcher.ready.clear();
+            if (over)
+                return false;
+            size_t window = limit - matcher.offset;
+            if (matcher.offset >= limit) {
+                if (matcher.first == InvalidState || matcher.attempts[matcher.first].start >= limit)
+                    return false;
+                // past limit skip() may outrun the attempts that matter, so let it read at most as far again
+                window = std::min(length - matcher.offset, std::max<size_t>(matcher.offset - limit, 1));
+            }
+            if (!matcher.skip(input + matcher.offset, window))
+                matcher.step(input[matcher.offset]);
+        }
+    };
+    auto scan = [this, &run](Chunk *chunk) {
+        StreamMatcher matcher(*this, false);
+        matcher.offset = chunk->begin;
+        run(matcher, chunk->end, [chunk](const Result &result) {
+            chunk->results.emplace_back(result);
+            return true;
+        });
+    };
+    std::vector<std::thread> workers;
+    for (unsigned i = 1; i < threads; ++i)
+        workers.emplace_back(scan, &chunks[i]);
+    scan(&chunks[0]);
+    for (auto &worker : workers)
+        worker.join();
+
+    size_t count = 0;
+    size_t offset = 0;
+    for (auto &chunk : chunks) {
+        auto &results = chunk.results;
+        auto following = [&results](size_t offset) {
+            return std::lower_bound(results.begin(), results.end(), offset, [](const Result &result, size_t offset) {
+                return size_t(result.start) < offset;
+            });
+        };
+        // the speculative scan resumed at every offset but those inside its matches
+        auto inside = [&results, &following](size_t offset) {
+            auto i = following(offset);
+            return i != results.begin() && size_t((i-1)->start + (i-1)->length) > offset;
+        };
+        auto report = [&](const Result &result) {
+            callback(result);
+            ++count;
+            offset = result.start + result.length;
+        };
+        while (offset < chunk.end) {
+            if (!inside(offset)) {
+                std::for_each(following(offset), results.end(), report);
+                break;
+            }
+            StreamMatcher matcher(*this, false);
+            matcher.offset = offset;
+            bool resumed = run(matcher, chunk.end, [&](const Result &result) {
+                report(result);
+                return offset < chunk.end && inside(offset);
+            });
+            if (!resumed)
+                break;
+        }
+        offset = std::max(offset, chunk.end);
+    }
+    return count;
+}
+
+/**
+ *  Reports every non-empty (start, length) pair that matches, overlapping
+ *  ones included, grouped by end offset. Attempts started at different
+ *  offsets that reach the same state share their future, so they are kept
+ *  in one list per state and moved together: each input byte costs one
+ *  transition per live state plus the matches it reports.
+**/
+size_t PoorInterpreter::searchOverlapping(const char *input, Callback callback) const {
+    struct Start {
+        uint32_t offset;
+        int32_t next;
+    };
+    std::vector<Start> starts;
+    int32_t freeStart = InvalidState;
+    std::vector<int32_t> head(stateCount, InvalidState), tail(stateCount, InvalidState);
+    std::vector<int32_t> nextHead(stateCount, InvalidState), nextTail(stateCount, InvalidState);
+    std::vector<int32_t> active, nextActive;
+    size_t count = 0;
+    Result result;
+    for (uint32_t offset = 0; ; ++offset) {
+        int32_t start = freeStart;
+        if (start == InvalidState) {
+            start = starts.size();
+            starts.emplace_back();
+        } else
+            freeStart = starts[start].next;
+        starts[start].offset = offset;
+        starts[start].next = InvalidState;
+        int32_t entry = getStartState(offset);
+        if (head[entry] == InvalidState) {
+            head[entry] = start;
+            active.emplace_back(entry);
+        } else
+            starts[tail[entry]].next = start;
+        tail[entry] = start;
+
+        const uint8_t *accepted = input[offset] ? acceptedStates : acceptedAtEnd;
+        for (auto state : active) {
+            if (!accepted[state])
+                continue;
+            for (int32_t i = head[state]; i != InvalidState; i = starts[i].next) {
+                if (starts[i].offset == offset)
+                    continue;
+                result.start = starts[i].offset;
+                result.length = offset - starts[i].offset;
+                result.terminateState = result.acceptedState = state;
+                callback(result);
+                ++count;
+            }
+        }
+        if (!input[offset])
+            break;
+
+        for (auto state : active) {
+            int32_t target = transit(state, input[offset]);
+            if (target == InvalidState) {
+                starts[tail[state]].next = freeStart;
+                freeStart = head[state];
+            } else if (nextHead[target] == InvalidState) {
+                nextHead[target] = head[state];
+                nextTail[target] = tail[state];
+                nextActive.emplace_back(target);
+            } else {
+                starts[nextTail[target]].next = head[state];
+                nextTail[target] = tail[state];
+            }
+            head[state] = tail[state] = InvalidState;
+        }
+        active.swap(nextActive);
+        nextActive.clear();
+        head.swap(nextHead);
+        tail.swap(nextTail);
+    }
+    return count;
+}
+
+bool PoorInterpreter::searchHead(const char *input, Result *result, uint32_t offset) const {
     if (offset > strlen(input))
         return false;
+    return scanHead(input, result, offset);
+}
+
+bool PoorInterpreter::scanHead(const char *input, size_t length, Result *result, uint32_t offset) const {
+    int32_t currentState = getStartState(offset);
+    int32_t acceptedState = InvalidState;
+    int32_t matched = -1;
+    size_t reading = offset;
+    while (currentState != InvalidState) {
+        if (reading == length) {
+            if (acceptedAtEnd[currentState]) {
+                acceptedState = currentState;
+                matched = reading - offset;
+            }
+            break;
+        }
+        if (acceptedStates[currentState]) {
+            acceptedState = currentState;
+            matched = reading - offset;
+        }
+        currentState = transit(currentState, input[reading++]);
+    }
+    if (result) {
+        result->start = offset;
+        result->length = matched;
+        result->terminateState = currentState;
+        result->acceptedState = acceptedState;
+    }
+    return acceptedState != InvalidState;
+}
+
+bool PoorInterpreter::scanHead(const char *input, Result *result, uint32_t offset) const {
     input += offset;
-    int32_t currentState = startState;
+    int32_t currentState = getStartState(offset);
     int32_t acceptedState = InvalidState;
     int32_t length = -1;
     const char *reading = input;
     while (currentState != InvalidState) {
+        if (!*reading) {
+            if (acceptedAtEnd[currentState]) {
+                acceptedState = currentState;
+                length = reading - input;
+            }
+            break;
+        }
         if (acceptedStates[currentState]) {
             acceptedState = currentState;
             length = reading - input;
         }
-        if (!*reading || *reading >= CharMapSize)
-            break;
-        int16_t charCat = charMap[*reading++];
-        currentState = transitionTable[currentState][charCat];
+        currentState = transit(currentState, *reading++);
     }
     if (result) {
         result->start = offset;
@@ -91,6 +621,421 @@ bool PoorInterpreter::searchHead(const char *input, Result *result, uint32_t off
     return acceptedState != InvalidState;
 }
 
+constexpr uint64_t StreamMatcher::NoMatch;
+
+StreamMatcher::StreamMatcher(PoorInterpreter::ConstPtr _interpreter, Callback _callback)
+        : table(_interpreter.get()), interpreter(_interpreter), callback(_callback), emptyMatches(false),
+          stateGroup(table->getStateCount(), PoorInterpreter::InvalidState),
+          nextStateGroup(table->getStateCount(), PoorInterpreter::InvalidState) {
+    reset();
+}
+
+StreamMatcher::StreamMatcher(const PoorInterpreter &_table, bool _emptyMatches)
+        : table(&_table), emptyMatches(_emptyMatches),
+          stateGroup(table->getStateCount(), PoorInterpreter::InvalidState),
+          nextStateGroup(table->getStateCount(), PoorInterpreter::InvalidState) {
+    reset();
+}
+
+void StreamMatcher::feed(const char *input, size_t length) {
+    for (const char *end = input + length; input != end; ) {
+        size_t skipped = skip(input, end - input);
+        input += skipped;
+        if (!skipped)
+            step(*input++);
+        if (!ready.empty()) {
+            for (auto &match : ready)
+                callback(match);
+            ready.clear();
+        }
+    }
+}
+
+void StreamMatcher::finish() {
+    end();
+    for (auto &match : ready)
+        callback(match);
+    reset();
+}
+
+void StreamMatcher::reset() {
+    clear();
+    offset = 0;
+    boundary = 0;
+}
+
+void StreamMatcher::clear() {
+    for (auto group : live) {
+        if (groups[group].state != PoorInterpreter::InvalidState)
+            stateGroup[groups[group].state] = PoorInterpreter::InvalidState;
+    }
+    live.clear();
+    attempts.clear();
+    groups.clear();
+    ready.clear();
+    freeAttempt = freeGroup = PoorInterpreter::InvalidState;
+    first = last = PoorInterpreter::InvalidState;
+    pending = 0;
+}
+
+/**
+ *  Every offset starts an attempt, queued by start; attempts that reach the
+ *  same state share a group and move together, so a byte costs one
+ *  transition per live state. The front attempt is reported once it is
+ *  over, and whatever starts inside its match is dropped. Attempts are also
+ *  dropped early when another one is sure to be reported instead or to
+ *  cover them:
+ *  - once the front attempt has a match, those starting inside it;
+ *  - those without a match sharing the state of the front attempt;
+ *  - those without a match sharing the state of an earlier attempt that has
+ *    none either, provided nothing accepted since the earlier one started
+ *    (the group's fresh attempt).
+**/
+void StreamMatcher::step(unsigned char c) {
+    const PoorInterpreter &dfa = *table;
+    uint64_t position = offset++;
+    bool starting = position == 0 || !dfa.isAnchoredAtBegin();
+    int32_t entry = dfa.getStartState(position);
+    if (starting && emptyMatches && dfa.isAccepted(entry)) {
+        // an empty match at position can only come from the attempt starting there
+        int32_t group = stateGroup[entry];
+        if (group == PoorInterpreter::InvalidState) {
+            group = stateGroup[entry] = makeGroup(entry);
+            live.emplace_back(group);
+        }
+        spawn(position, position, group);
+        starting = false;
+    }
+    for (auto group : live) {
+        Group &current = groups[group];
+        if (current.size && dfa.isAccepted(current.state)) {
+            current.accepted = boundary = position;
+            current.acceptedState = current.state;
+        }
+    }
+
+    for (auto group : live) {
+        int32_t state = groups[group].state;
+        stateGroup[state] = PoorInterpreter::InvalidState;
+        int32_t target = groups[group].size ? dfa.transit(state, c) : PoorInterpreter::InvalidState;
+        if (target == PoorInterpreter::InvalidState) {
+            kill(group, PoorInterpreter::InvalidState);
+            continue;
+        }
+        int32_t other = nextStateGroup[target];
+        if (other == PoorInterpreter::InvalidState) {
+            groups[group].state = target;
+            nextStateGroup[target] = group;
+            nextLive.emplace_back(group);
+        } else if (groups[other].size >= groups[group].size) {
+            merge(group, other);
+        } else {
+            merge(other, group);
+            groups[group].state = target;
+            nextStateGroup[target] = group;
+            nextLive.emplace_back(group);
+        }
+    }
+    live.clear();
+    for (auto group : nextLive) {
+        if (groups[group].state != PoorInterpreter::InvalidState)
+            live.emplace_back(group);
+    }
+    nextLive.clear();
+    stateGroup.swap(nextStateGroup);
+
+    int32_t target = starting ? dfa.transit(entry, c) : PoorInterpreter::InvalidState;
+    if (target != PoorInterpreter::InvalidState) {
+        int32_t group = stateGroup[target];
+        if (group == PoorInterpreter::InvalidState) {
+            group = stateGroup[target] = makeGroup(target);
+            live.emplace_back(group);
+            groups[group].fresh = spawn(position, position + 1, group);
+        } else if ((first == PoorInterpreter::InvalidState || attempts[first].group != group) && !isFresh(groups[group].fresh)) {
+            groups[group].fresh = spawn(position, position + 1, group);
+        }
+    }
+    commit();
+}
+
+/**
+ *  The common stretches, handled without step(): nothing pending, or one
+ *  attempt running alone that every attempt starting meanwhile would be
+ *  dropped into. Returns how many bytes it took, stopping early once a
+ *  match is ready.
+**/
+size_t StreamMatcher::skip(const char *input, size_t length) {
+    const PoorInterpreter &dfa = *table;
+    const unsigned char *begin = reinterpret_cast<const unsigned char *>(input);
+    const unsigned char *reading = begin, *end = begin + length;
+    while (reading != end) {
+        bool starting = offset == 0 || !dfa.isAnchoredAtBegin();
+        int32_t entry = dfa.getStartState(offset);
+        if (starting && emptyMatches && dfa.isAccepted(entry))
+            break;
+        int32_t restart = starting ? dfa.transit(entry, *reading) : PoorInterpreter::InvalidState;
+        if (first == PoorInterpreter::InvalidState) {
+            if (restart != PoorInterpreter::InvalidState) {
+                if (!live.empty())
+                    break;
+                int32_t group = stateGroup[restart] = makeGroup(restart);
+                live.emplace_back(group);
+                groups[group].fresh = spawn(offset, offset + 1, group);
+            }
+            ++offset;
+            ++reading;
+            continue;
+        }
+        if (pending != 1 || live.size() != 1 || attempts[first].group == PoorInterpreter::InvalidState)
+            break;
+        Group &group = groups[live.front()];
+        int32_t state = group.state;
+        bool over = false;
+        for (; reading != end; ++reading, ++offset) {
+            int32_t target = dfa.transit(state, *reading);
+            if (starting) {
+                entry = dfa.getStartState(offset);
+                restart = dfa.transit(entry, *reading);
+                if ((restart != target && restart != PoorInterpreter::InvalidState) || (emptyMatches && dfa.isAccepted(entry)))
+                    break;
+            }
+            if (dfa.isAccepted(state)) {
+                group.accepted = boundary = offset;
+                group.acceptedState = state;
+            }
+            if (target == PoorInterpreter::InvalidState) {
+                over = true;
+                break;
+            }
+            state = target;
+        }
+        if (!over) {
+            stateGroup[group.state] = PoorInterpreter::InvalidState;
+            stateGroup[state] = live.front();
+            group.state = state;
+            break;
+        }
+        // the attempt is over and none starts at this byte
+        ++offset;
+        ++reading;
+        stateGroup[group.state] = PoorInterpreter::InvalidState;
+        kill(live.front(), PoorInterpreter::InvalidState);
+        live.clear();
+        commit();
+        if (!ready.empty())
+            break;
+    }
+    return reading - begin;
+}
+
+void StreamMatcher::end() {
+    const PoorInterpreter &dfa = *table;
+    uint64_t position = offset;
+    int32_t entry = dfa.getStartState(position);
+    if ((position == 0 || !dfa.isAnchoredAtBegin()) && emptyMatches && dfa.isAcceptedAtEnd(entry)) {
+        int32_t group = stateGroup[entry];
+        if (group == PoorInterpreter::InvalidState) {
+            group = stateGroup[entry] = makeGroup(entry);
+            live.emplace_back(group);
+        }
+        spawn(position, position, group);
+    }
+    for (auto group : live) {
+        int32_t state = groups[group].state;
+        stateGroup[state] = PoorInterpreter::InvalidState;
+        if (dfa.isAcceptedAtEnd(state)) {
+            groups[group].accepted = position;
+            groups[group].acceptedState = state;
+        }
+        kill(group, state);
+    }
+    live.clear();
+    commit();
+}
+
+void StreamMatcher::commit() {
+    while (first != PoorInterpreter::InvalidState) {
+        Attempt &attempt = attempts[first];
+        uint64_t end = endOf(first);
+        if (attempt.group != PoorInterpreter::InvalidState) {
+            if (end != NoMatch) {
+                while (attempt.next != PoorInterpreter::InvalidState && attempts[attempt.next].start < end)
+                    release(attempt.next);
+            }
+            return;
+        }
+        if (end != NoMatch) {
+            Match match;
+            match.start = attempt.start;
+            match.length = end - attempt.start;
+            match.terminateState = attempt.terminateState;
+            match.acceptedState = attempt.acceptedState;
+            ready.emplace_back(match);
+        }
+        release(first);
+        while (first != PoorInterpreter::InvalidState && attempts[first].start < end && end != NoMatch)
+            release(first);
+    }
+}
+
+uint64_t StreamMatcher::endOf(int32_t attempt) const {
+    const Attempt &current = attempts[attempt];
+    if (current.group != PoorInterpreter::InvalidState) {
+        const Group &group = groups[current.group];
+        if (group.accepted != NoMatch && group.accepted >= current.joined)
+            return group.accepted;
+    }
+    return current.end;
+}
+
+bool StreamMatcher::isFresh(int32_t attempt) const {
+    return attempt != PoorInterpreter::InvalidState && endOf(attempt) == NoMatch && attempts[attempt].start >= boundary;
+}
+
+// Leaves the group, keeping what the group accepted while the attempt was in it
+void StreamMatcher::detach(int32_t attempt) {
+    Attempt &current = attempts[attempt];
+    Group &group = groups[current.group];
+    if (group.accepted != NoMatch && group.accepted >= current.joined) {
+        current.end = group.accepted;
+        current.acceptedState = group.acceptedState;
+    }
+    if (current.previousInGroup == PoorInterpreter::InvalidState)
+        group.head = current.nextInGroup;
+    else
+        attempts[current.previousInGroup].nextInGroup = current.nextInGroup;
+    if (current.nextInGroup == PoorInterpreter::InvalidState)
+        group.tail = current.previousInGroup;
+    else
+        attempts[current.nextInGroup].previousInGroup = current.previousInGroup;
+    if (group.fresh == attempt)
+        group.fresh = PoorInterpreter::InvalidState;
+    --group.size;
+    current.group = PoorInterpreter::InvalidState;
+}
+
+void StreamMatcher::attach(int32_t attempt, int32_t group, uint64_t joined) {
+    Attempt &current = attempts[attempt];
+    Group &into = groups[group];
+    current.group = group;
+    current.joined = joined;
+    current.previousInGroup = into.tail;
+    current.nextInGroup = PoorInterpreter::InvalidState;
+    if (into.tail == PoorInterpreter::InvalidState)
+        into.head = attempt;
+    else
+        attempts[into.tail].nextInGroup = attempt;
+    into.tail = attempt;
+    ++into.size;
+}
+
+int32_t StreamMatcher::spawn(uint64_t start, uint64_t joined, int32_t group) {
+    int32_t attempt = freeAttempt;
+    if (attempt == PoorInterpreter::InvalidState) {
+        attempt = attempts.size();
+        attempts.emplace_back();
+    } else
+        freeAttempt = attempts[attempt].next;
+    Attempt &current = attempts[attempt];
+    current.start = start;
+    current.end = NoMatch;
+    current.terminateState = current.acceptedState = PoorInterpreter::InvalidState;
+    current.previous = last;
+    current.next = PoorInterpreter::InvalidState;
+    if (last == PoorInterpreter::InvalidState)
+        first = attempt;
+    else
+        attempts[last].next = attempt;
+    last = attempt;
+    attach(attempt, group, joined);
+    ++pending;
+    return attempt;
+}
+
+void StreamMatcher::release(int32_t attempt) {
+    Attempt &current = attempts[attempt];
+    if (current.group != PoorInterpreter::InvalidState)
+        detach(attempt);
+    if (current.previous == PoorInterpreter::InvalidState)
+        first = current.next;
+    else
+        attempts[current.previous].next = current.next;
+    if (current.next == PoorInterpreter::InvalidState)
+        last = current.previous;
+    else
+        attempts[current.next].previous = current.previous;
+    current.next = freeAttempt;
+    freeAttempt = attempt;
+    --pending;
+}
+
+int32_t StreamMatcher::makeGroup(int32_t state) {
+    int32_t group = freeGroup;
+    if (group == PoorInterpreter::InvalidState) {
+        group = groups.size();
+        groups.emplace_back();
+    } else
+        freeGroup = groups[group].head;
+    Group &current = groups[group];
+    current.state = state;
+    current.head = current.tail = current.fresh = PoorInterpreter::InvalidState;
+    current.size = 0;
+    current.acceptedState = PoorInterpreter::InvalidState;
+    current.accepted = NoMatch;
+    return group;
+}
+
+// Ends every attempt of the group; those without a match are dropped at once
+void StreamMatcher::kill(int32_t group, int32_t terminateState) {
+    while (groups[group].head != PoorInterpreter::InvalidState) {
+        int32_t attempt = groups[group].head;
+        detach(attempt);
+        attempts[attempt].terminateState = terminateState;
+        if (attempts[attempt].end == NoMatch)
+            release(attempt);
+    }
+    groups[group].state = PoorInterpreter::InvalidState;
+    groups[group].head = freeGroup;
+    freeGroup = group;
+}
+
+/**
+ *  Moves the attempts of from into into, whose state they have just
+ *  reached too, and frees from; the caller passes the smaller group as
+ *  from. Only the fresher of two fresh attempts is dropped, and the moved
+ *  attempts that now share the state of the front attempt.
+**/
+void StreamMatcher::merge(int32_t from, int32_t into) {
+    bool front = first != PoorInterpreter::InvalidState && attempts[first].group == into;
+    uint64_t frontEnd = front ? endOf(first) : NoMatch;
+    int32_t fresh = isFresh(groups[into].fresh) ? groups[into].fresh : PoorInterpreter::InvalidState;
+    int32_t otherFresh = isFresh(groups[from].fresh) ? groups[from].fresh : PoorInterpreter::InvalidState;
+    if (fresh != PoorInterpreter::InvalidState && otherFresh != PoorInterpreter::InvalidState) {
+        if (attempts[otherFresh].start < attempts[fresh].start) {
+            release(fresh);
+            fresh = PoorInterpreter::InvalidState;
+        } else {
+            release(otherFresh);
+            otherFresh = PoorInterpreter::InvalidState;
+        }
+    }
+    while (groups[from].head != PoorInterpreter::InvalidState) {
+        int32_t attempt = groups[from].head;
+        detach(attempt);
+        uint64_t end = attempts[attempt].end;
+        if (front && (end == NoMatch || (frontEnd != NoMatch && frontEnd > attempts[attempt].start))) {
+            release(attempt);
+            if (attempt == otherFresh)
+                otherFresh = PoorInterpreter::InvalidState;
+        } else
+            attach(attempt, into, offset);
+    }
+    groups[into].fresh = fresh != PoorInterpreter::InvalidState ? fresh : otherFresh;
+    groups[from].state = PoorInterpreter::InvalidState;
+    groups[from].head = freeGroup;
+    freeGroup = from;
+}
+
 RichInterpreter::RichInterpreter(Automaton::Ptr _dfa) : dfa(_dfa), savedMap(dfa->states.size()) {
     int32_t index = 0;
     for (auto state : dfa->states) {
@@ -121,18 +1066,64 @@ bool RichInterpreter::search(const char *input, Result *result, uint32_t offset)
         if (searchHead(input, result, offset++))
             return true;
     } while (input[offset]);
+    return false;
 }
 
 bool RichInterpreter::searchHead(const char *input, Result *result, uint32_t offset) {
     if (offset > strlen(input))
         return false;
+    std::vector<StatusSaver> statusStack;
+    return searchHead(input, result, offset, statusStack);
+}
+
+/**
+ *  Attempts still start at every offset, but configurations one attempt
+ *  has ruled out are never explored again by the next ones, so the whole
+ *  scan visits each (state, offset) pair at most once plus the matches.
+**/
+size_t RichInterpreter::searchAll(const char *input, Callback callback) {
+    size_t count = 0;
+    Result result;
+    std::vector<StatusSaver> statusStack;
+    FailureMemo memo;
+    memo.horizon = 0;
+    for (uint32_t offset = 0; input[offset]; ) {
+        statusStack.clear();
+        if (offset > memo.horizon)
+            memo.failed.clear();
+        if (searchHead(input, &result, offset, statusStack, &memo) && result.length > 0) {
+            callback(result);
+            ++count;
+            offset += result.length;
+        } else
+            ++offset;
+    }
+    return count;
+}
+
+bool RichInterpreter::searchHead(const char *input, Result *result, uint32_t offset, std::vector<StatusSaver> &statusStack, FailureMemo *memo) {
+    const char *origin = input;
     input += offset;
-    const char *read = input;
-    std::stack<StatusSaver> statusStack;
     StatusSaver currentStatus;
     currentStatus.state = dfa->startState;
     currentStatus.reading = input;
     currentStatus.transition = dfa->startState->outbounds.begin();
+    auto configuration = [this, origin](const StatusSaver &status) {
+        return uint64_t(status.reading - origin) * stateMap.size() + stateMap[status.state];
+    };
+    // everything entered since the branch being resumed was taken led nowhere
+    auto backtrack = [memo](size_t entered) {
+        if (!memo)
+            return;
+        for (size_t i = entered; i < memo->entered.size(); ++i)
+            memo->failed.emplace(memo->entered[i]);
+        memo->entered.resize(entered);
+    };
+    if (memo) {
+        memo->entered.clear();
+        if (!currentStatus.state->isAccepted)
+            memo->entered.emplace_back(configuration(currentStatus));
+    }
     while (true) {
         StatusSaver saved = currentStatus;
         bool found = false;
@@ -160,21 +1151,34 @@ bool RichInterpreter::searchHead(const char *input, Result *result, uint32_t off
                 if (savedMap[stateMap[currentStatus.state]]) {
                     saved.transition = transition;
                     ++(saved.transition);
-                    statusStack.push(saved);
+                    saved.entered = memo ? memo->entered.size() : 0;
+                    statusStack.push_back(saved);
                 }
                 currentStatus.state = (*transition)->target;
                 currentStatus.transition = currentStatus.state->outbounds.begin();
                 break;
             }
         }
+        if (found && memo && !currentStatus.state->isAccepted) {
+            uint64_t entered = configuration(currentStatus);
+            if (memo->failed.count(entered))
+                found = false;
+            else {
+                memo->entered.emplace_back(entered);
+                memo->horizon = std::max<uint64_t>(memo->horizon, currentStatus.reading - origin);
+            }
+        }
         if (currentStatus.state->isAccepted && (!found || *currentStatus.reading == '\0'))
             break;
         if (!found) {
             if (!statusStack.empty()) {
-                currentStatus = statusStack.top();
-                statusStack.pop();
-            } else
+                currentStatus = statusStack.back();
+                statusStack.pop_back();
+                backtrack(currentStatus.entered);
+            } else {
+                backtrack(0);
                 break;
+            }
             if (currentStatus.state->isAccepted)
                 break;
         }
@@ -0,0 +1,333 @@
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <vector>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "regex_jit.h"
+
+constexpr int JitInterpreter::MaxScanStops;
+
+#if defined(__x86_64__)
+namespace {
+constexpr int64_t Unbound = -1;
+
+/**
+ *  Just enough of an x86-64 encoder for the matcher. Registers, fixed for
+ *  the whole function (System V: rdi = input, rsi = output, edx = nonzero
+ *  when input is the beginning of the text, until the entry dispatch):
+ *      rcx     reading pointer
+ *      rdx     reading pointer at the last accepting state, 0 if none
+ *      r8d     last accepting state
+ *      r9d     current state, reported as the terminate state
+ *      eax     current byte
+**/
+class Assembler {
+public:
+    using Label = size_t;
+protected:
+    std::vector<uint8_t> bytes;
+    std::vector<int64_t> labels;
+    std::vector<std::pair<size_t, Label>> fixups;
+    void rel32(Label target) {
+        fixups.emplace_back(bytes.size(), target);
+        imm32(0);
+    }
+public:
+    Label label() {
+        labels.push_back(Unbound);
+        return labels.size() - 1;
+    }
+    void bind(Label label) {
+        labels[label] = bytes.size();
+    }
+    void emit(std::initializer_list<uint8_t> code) {
+        bytes.insert(bytes.end(), code);
+    }
+    void imm32(int32_t value) {
+        for (int i = 0; i < 4; ++i)
+            bytes.push_back(static_cast<uint32_t>(value) >> (i * 8));
+    }
+    void align(size_t alignment) {
+        while (bytes.size() % alignment)
+            bytes.push_back(0x90);
+    }
+    void jmp(Label target) {
+        emit({0xE9});
+        rel32(target);
+    }
+    void jz(Label target) {
+        emit({0x0F, 0x84});
+        rel32(target);
+    }
+    void jnz(Label target) {
+        emit({0x0F, 0x85});
+        rel32(target);
+    }
+    void jbe(Label target) {
+        emit({0x0F, 0x86});
+        rel32(target);
+    }
+    // movdqa xmm2, [rip + constant]
+    void loadConstant(Label constant) {
+        emit({0x66, 0x0F, 0x6F, 0x15});
+        rel32(constant);
+    }
+    void movR8d(int32_t value) {
+        emit({0x41, 0xB8});
+        imm32(value);
+    }
+    void movR9d(int32_t value) {
+        emit({0x41, 0xB9});
+        imm32(value);
+    }
+    void cmpEax(int32_t value) {
+        emit({0x3D});
+        imm32(value);
+    }
+    // lea r9d, [rax - begin]; cmp r9d, end - begin
+    void inRange(int32_t begin, int32_t end) {
+        emit({0x44, 0x8D, 0x88});
+        imm32(-begin);
+        emit({0x41, 0x81, 0xF9});
+        imm32(end - begin);
+    }
+    bool link() {
+        for (auto &fixup : fixups) {
+            if (labels[fixup.second] == Unbound)
+                return false;
+            int32_t displacement = labels[fixup.second] - static_cast<int64_t>(fixup.first + 4);
+            memcpy(&bytes[fixup.first], &displacement, sizeof(displacement));
+        }
+        return true;
+    }
+    const std::vector<uint8_t> &code() const {
+        return bytes;
+    }
+};
+
+// maximal runs of bytes 1..255 sharing a target; NUL always ends the input
+struct Run {
+    int32_t begin;
+    int32_t end;
+    int32_t target;
+};
+
+std::vector<Run> runs(const PoorInterpreter &interpreter, int32_t state) {
+    std::vector<Run> result;
+    for (int32_t c = 1; c < PoorInterpreter::CharMapSize; ++c) {
+        int32_t target = interpreter.transit(state, c);
+        if (!result.empty() && result.back().target == target && result.back().end == c - 1)
+            result.back().end = c;
+        else
+            result.push_back(Run{c, c, target});
+    }
+    return result;
+}
+}
+
+bool JitInterpreter::compile() {
+    const PoorInterpreter &table = *interpreter;
+    int32_t stateCount = table.getStateCount();
+    Assembler as;
+    std::vector<Assembler::Label> states(stateCount), dispatches(stateCount);
+    for (int32_t i = 0; i < stateCount; ++i) {
+        states[i] = as.label();
+        dispatches[i] = as.label();
+    }
+    Assembler::Label finish = as.label(), dead = as.label(), noMatch = as.label(), begin = as.label();
+    std::map<uint8_t, Assembler::Label> constants;
+
+    bool anchored = table.getBeginState() != table.getStartState();
+    as.emit({0x48, 0x89, 0xF9});                        // mov rcx, rdi
+    as.movR8d(PoorInterpreter::InvalidState);
+    if (anchored) {
+        as.emit({0x85, 0xD2});                          // test edx, edx
+        as.jnz(begin);
+    }
+    as.emit({0x31, 0xD2});                              // xor edx, edx
+    as.jmp(states[table.getStartState()]);
+    if (anchored) {
+        as.bind(begin);
+        as.emit({0x31, 0xD2});                          // xor edx, edx
+        as.jmp(states[table.getBeginState()]);
+    }
+
+    for (int32_t state = 0; state < stateCount; ++state) {
+        auto stateRuns = runs(table, state);
+        std::vector<uint8_t> stops;
+        for (auto &run : stateRuns) {
+            for (int32_t c = run.begin; run.target != state && c <= run.end && stops.size() <= MaxScanStops; ++c)
+                stops.push_back(c);
+        }
+        bool scan = stops.size() <= MaxScanStops;
+
+        as.bind(states[state]);
+        as.movR9d(state);
+        if (table.isAccepted(state)) {
+            as.emit({0x48, 0x89, 0xCA});                // mov rdx, rcx
+            as.movR8d(state);
+        }
+        if (scan) {
+            // 16 bytes at a time while none is a stop byte or NUL; aligned
+            // loads never cross into an unmapped page past the terminator
+            Assembler::Label loop = as.label(), found = as.label();
+            as.emit({0xF6, 0xC1, 0x0F});                // test cl, 15
+            as.jnz(dispatches[state]);
+            as.bind(loop);
+            as.emit({0x66, 0x0F, 0x6F, 0x01});          // movdqa xmm0, [rcx]
+            as.emit({0x66, 0x0F, 0xEF, 0xC9});          // pxor xmm1, xmm1
+            as.emit({0x66, 0x0F, 0x74, 0xC8});          // pcmpeqb xmm1, xmm0
+            for (auto stop : stops) {
+                if (!constants.count(stop))
+                    constants.emplace(stop, as.label());
+                as.loadConstant(constants[stop]);
+                as.emit({0x66, 0x0F, 0x74, 0xD0});      // pcmpeqb xmm2, xmm0
+                as.emit({0x66, 0x0F, 0xEB, 0xCA});      // por xmm1, xmm2
+            }
+            as.emit({0x66, 0x0F, 0xD7, 0xC1});          // pmovmskb eax, xmm1
+            as.emit({0x85, 0xC0});                      // test eax, eax
+            as.jnz(found);
+            as.emit({0x48, 0x83, 0xC1, 0x10});          // add rcx, 16
+            as.jmp(loop);
+            as.bind(found);
+            as.emit({0x0F, 0xBC, 0xC0});                // bsf eax, eax
+            as.emit({0x48, 0x01, 0xC1});                // add rcx, rax
+            if (table.isAccepted(state))
+                as.emit({0x48, 0x89, 0xCA});            // mov rdx, rcx
+        }
+        // a state accepting only where $ holds records that at the NUL
+        bool acceptsAtEnd = table.isAcceptedAtEnd(state) && !table.isAccepted(state);
+        Assembler::Label atEnd = acceptsAtEnd ? as.label() : finish;
+        as.bind(dispatches[state]);
+        as.emit({0x0F, 0xB6, 0x01});                    // movzx eax, byte [rcx]
+        as.emit({0x85, 0xC0});                          // test eax, eax
+        as.jz(atEnd);
+        as.emit({0x48, 0xFF, 0xC1});                    // inc rcx
+
+        // the target reached by most runs is the fall-through
+        std::map<int32_t, size_t> counts;
+        for (auto &run : stateRuns)
+            ++counts[run.target];
+        int32_t fallThrough = std::max_element(counts.begin(), counts.end(),
+                [](const std::pair<const int32_t, size_t> &a, const std::pair<const int32_t, size_t> &b) {
+                    return a.second < b.second;
+                })->first;
+        for (auto &run : stateRuns) {
+            if (run.target == fallThrough)
+                continue;
+            Assembler::Label target = run.target == PoorInterpreter::InvalidState ? dead : states[run.target];
+            if (run.begin == run.end) {
+                as.cmpEax(run.begin);
+                as.jz(target);
+            } else {
+                as.inRange(run.begin, run.end);
+                as.jbe(target);
+            }
+        }
+        as.jmp(fallThrough == PoorInterpreter::InvalidState ? dead : states[fallThrough]);
+        if (acceptsAtEnd) {
+            as.bind(atEnd);
+            as.emit({0x48, 0x89, 0xCA});                // mov rdx, rcx
+            as.movR8d(state);
+            as.jmp(finish);
+        }
+    }
+
+    as.bind(dead);
+    as.movR9d(PoorInterpreter::InvalidState);
+    as.bind(finish);
+    as.emit({0x44, 0x89, 0x4E, 0x08});                  // mov [rsi + 8], r9d
+    as.emit({0x44, 0x89, 0x46, 0x0C});                  // mov [rsi + 12], r8d
+    as.emit({0x48, 0x85, 0xD2});                        // test rdx, rdx
+    as.jz(noMatch);
+    as.emit({0x48, 0x29, 0xFA});                        // sub rdx, rdi
+    as.emit({0x48, 0x89, 0x16});                        // mov [rsi], rdx
+    as.emit({0xC3});                                    // ret
+    as.bind(noMatch);
+    as.emit({0x48, 0xC7, 0x06, 0xFF, 0xFF, 0xFF, 0xFF}); // mov qword [rsi], -1
+    as.emit({0xC3});                                    // ret
+
+    for (auto &constant : constants) {
+        as.align(16);
+        as.bind(constant.second);
+        for (int i = 0; i < 16; ++i)
+            as.emit({constant.first});
+    }
+    if (!as.link())
+        return false;
+
+    const std::vector<uint8_t> &bytes = as.code();
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t size = (bytes.size() + page - 1) / page * page;
+    void *buffer = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buffer == MAP_FAILED)
+        return false;
+    memcpy(buffer, bytes.data(), bytes.size());
+    if (mprotect(buffer, size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(buffer, size);
+        return false;
+    }
+    code.reset(buffer, [size](void *p) {
+        munmap(p, size);
+    });
+    function = reinterpret_cast<Function>(buffer);
+    return true;
+}
+#else
+bool JitInterpreter::compile() {
+    return false;
+}
+#endif
+
+JitInterpreter::JitInterpreter(PoorInterpreter::ConstPtr _interpreter, bool enable) : interpreter(_interpreter), function(nullptr) {
+    if (enable)
+        compile();
+}
+
+bool JitInterpreter::scanHead(const char *input, Result *result, uint32_t offset) const {
+    Output output;
+    function(input + offset, &output, offset == 0);
+    if (result) {
+        result->start = offset;
+        result->length = output.length;
+        result->terminateState = output.terminateState;
+        result->acceptedState = output.acceptedState;
+    }
+    return output.acceptedState != PoorInterpreter::InvalidState;
+}
+
+bool JitInterpreter::searchHead(const char *input, Result *result, uint32_t offset) const {
+    if (!function)
+        return interpreter->searchHead(input, result, offset);
+    if (offset > strlen(input))
+        return false;
+    return scanHead(input, result, offset);
+}
+
+bool JitInterpreter::match(const char *input) const {
+    Result result;
+    return searchHead(input, &result, 0) && result.length == static_cast<int32_t>(strlen(input));
+}
+
+bool JitInterpreter::search(const char *input, Result *result, uint32_t offset) const {
+    if (!function)
+        return interpreter->search(input, result, offset);
+    size_t length = strlen(input);
+    if (offset > length)
+        return false;
+    do {
+        if (scanHead(input, result, offset++))
+            return true;
+    } while (offset < length && !interpreter->isAnchoredAtBegin());
+    return false;
+}
+
+/**
+ *  The generated code follows one attempt at a time, so searchAll would
+ *  have to restart it at every offset, which is quadratic on long
+ *  undecided attempts. The table interpreter's single pass is used instead.
+**/
+size_t JitInterpreter::searchAll(const char *input, Callback callback) const {
+    return interpreter->searchAll(input, callback);
+}
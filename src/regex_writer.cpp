@@ -22,35 +22,32 @@ RegexNode RegexNode::repeat(int32_t min, int32_t max, bool isGreedy) const {
     return RegexNode(Expression::Ptr(expr));
 }
 
-RegexNode RegexNode::operator+(RegexNode node) const {
-    ConcatenationExpression *expr = new ConcatenationExpression;
-    expr->left = this->expression;
-    expr->right = node.expression;
+RegexNode RegexNode::group(int32_t index) const {
+    GroupExpression *expr = new GroupExpression(index);
+    expr->expression = this->expression;
     return RegexNode(Expression::Ptr(expr));
 }
 
+RegexNode RegexNode::operator+(RegexNode node) const {
+    return RegexNode(concatenate({this->expression, node.expression}));
+}
+
 RegexNode RegexNode::operator|(RegexNode node) const {
-    SelectExpression *expr = new SelectExpression;
-    expr->left = this->expression;
-    expr->right = node.expression;
-    return RegexNode(Expression::Ptr(expr));
+    return RegexNode(alternate({this->expression, node.expression}));
 }
 
 RegexNode RegexNode::operator<<=(RegexNode node) const {
-    SetExpression *lhs = dynamic_cast<SetExpression *>(this->expression.get());
-    SetExpression *rhs = dynamic_cast<SetExpression *>(node.expression.get());
+    SetExpression *lhs = expressionCast<SetExpression>(this->expression);
+    SetExpression *rhs = expressionCast<SetExpression>(node.expression);
     assertm(lhs && rhs && !lhs->isComplementary && !rhs->isComplementary, "RegexNode::operator%%(const RegexNode &node) only union non-complementary SetExpression");
-    SelectExpression *select = new SelectExpression;
-    select->left = lhs->expression;
-    select->right = rhs->expression;
     SetExpression *expr = new SetExpression;
-    expr->expression = Expression::Ptr(select);
+    expr->expression = alternate({lhs->expression, rhs->expression});
     expr->isComplementary = false;
     return RegexNode(Expression::Ptr(expr));
 }
 
 RegexNode RegexNode::operator!() const {
-    SetExpression *thiz = dynamic_cast<SetExpression *>(this->expression.get());
+    SetExpression *thiz = expressionCast<SetExpression>(this->expression);
     assertm(thiz, "RegexNode::operator!() only flip Set Expression");
     thiz->isComplementary = !thiz->isComplementary;
     return *this;
@@ -0,0 +1,98 @@
+// Step 1. Include necessary header files such that the stuff your
+// test logic needs is declared.
+//
+// Don't forget gtest.h, which declares the testing framework.
+
+#include <string>
+#include <vector>
+#include "dictionary.h"
+#include "regex_expression.h"
+#include "regex_interpreter.h"
+#include "gtest/gtest.h"
+
+using std::string;
+
+// Step 2. Use the TEST macro to define your tests.
+//
+// TEST has two parameters: the test case name and the test name.
+// After using the macro, you should define your test logic between a
+// pair of braces.  You can use a bunch of macros to indicate the
+// success or failure of a test.  EXPECT_TRUE and EXPECT_EQ are
+// examples of such macros.  For a complete list, see gtest.h.
+
+std::vector<string> keywords = {
+    "while", "volatile", "void", "unsigned", "union", "typedef", "switch", "struct", "static", "sizeof", "signed",
+    "short", "return", "register", "long", "int", "if", "goto", "for", "float", "extern", "enum", "else",
+    "double", "do", "default", "continue", "const", "char", "case", "break", "auto"
+};
+
+TEST(Dictionary, Match) {
+    auto dfa = buildDictionary(keywords);
+    PoorInterpreter interpreter(dfa);
+    for (auto &keyword : keywords)
+        EXPECT_TRUE(interpreter.match(keyword.c_str()));
+    EXPECT_FALSE(interpreter.match(""));
+    EXPECT_FALSE(interpreter.match("whil"));
+    EXPECT_FALSE(interpreter.match("integer"));
+    EXPECT_FALSE(interpreter.match("d"));
+}
+
+TEST(Dictionary, Minimal) {
+    ExpressionArena arena;
+    ExpressionArena::Scope scope(arena);
+    auto dfa = buildDictionary(keywords);
+    string pattern;
+    for (auto &keyword : keywords)
+        pattern += (pattern.empty() ? "" : "|") + keyword;
+    auto nfa = parseRegex(pattern)->generateEpsilonNfa();
+    std::map<State::List, State::Ptr> nfaStateMap;
+    std::map<State::Ptr, State::Ptr> dfaStateMap;
+    auto mdfa = Hopcroft(powerset(nfa, poorEpsilonChecker, nfaStateMap), dfaStateMap);
+    EXPECT_EQ(dfa->states.size(), mdfa->states.size());
+}
+
+TEST(Dictionary, Incremental) {
+    DictionaryBuilder builder;
+    builder.insert("");
+    builder.insert("tap");
+    builder.insert("taps");
+    builder.insert("taps");
+    builder.insert("top");
+    builder.insert("tops");
+    PoorInterpreter interpreter(builder.build());
+    EXPECT_EQ(builder.size(), 5u);
+    EXPECT_TRUE(interpreter.match(""));
+    EXPECT_TRUE(interpreter.match("tops"));
+    EXPECT_TRUE(interpreter.match("tap"));
+    EXPECT_FALSE(interpreter.match("ta"));
+    EXPECT_FALSE(interpreter.match("tapss"));
+}
+
+TEST(Dictionary, InsertAfterBuild) {
+    std::vector<string> words = {"ab", "bb", "bc", "bcd", "tap", "taps", "top", "tops"};
+    DictionaryBuilder builder;
+    for (size_t i = 0; i < words.size(); ++i) {
+        builder.insert(words[i]);
+        builder.insert(words[i]);
+        auto dfa = builder.build();
+        EXPECT_EQ(dfa->states.size(), buildDictionary(std::vector<string>(words.begin(), words.begin() + i + 1))->states.size());
+        PoorInterpreter interpreter(dfa);
+        for (size_t j = 0; j < words.size(); ++j)
+            EXPECT_EQ(interpreter.match(words[j].c_str()), j <= i) << words[j] << " after " << words[i];
+        EXPECT_FALSE(interpreter.match("ac"));
+        EXPECT_FALSE(interpreter.match("tb"));
+    }
+    EXPECT_EQ(builder.size(), buildDictionary(words)->states.size());
+}
+
+// Step 3. Call RUN_ALL_TESTS() in main().
+//
+// We do this by linking in src/gtest_main.cc file, which consists of
+// a main() function which calls RUN_ALL_TESTS() for us.
+//
+// This runs all the tests you've defined, prints the result, and
+// returns 0 if successful, or 1 otherwise.
+//
+// Did you notice that we didn't register the tests?  The
+// RUN_ALL_TESTS() macro magically knows about all the tests we
+// defined.  Isn't this convenient?
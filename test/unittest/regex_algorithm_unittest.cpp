@@ -5,6 +5,7 @@
 
 #include <climits>
 #include <iostream>
+#include "regex_algorithm.h"
 #include "regex_expression.h"
 #include "regex_writer.h"
 #include "gtest/gtest.h"
@@ -24,7 +25,7 @@
     Range<unsigned char>::List unifiedRanges; \
     auto  regex = parseRegex(input); \
     regex->setNormalize(&unifiedRanges); \
-    EXPECT_TRUE(regex->equals((node).expression.get())); \
+    EXPECT_TRUE(regex->equals((node).expression)); \
 } while (0)
 
 #define SET_UNIFICATION_ASSERT(str, node) { \
@@ -33,10 +34,22 @@
     auto  regex = parseRegex(input); \
     regex->setNormalize(&unifiedRanges); \
     regex->setUnify(unifiedRanges); \
-    EXPECT_TRUE(regex->equals((node).expression.get())); \
+    EXPECT_TRUE(regex->equals((node).expression)); \
+} while (0)
+
+#define SIMPLIFICATION_ASSERT(str, node) { \
+    EXPECT_TRUE(simplify(parseRegex(str))->equals((node).expression)); \
+} while (0)
+
+#define FACTORIZATION_ASSERT(str, node) { \
+    const char *input = str; \
+    auto  regex = factorize(parseRegex(input)); \
+    EXPECT_TRUE(regex->equals((node).expression)); \
 } while (0)
 
 TEST(RegexAlgorithm, SetNormalization) {
+    ExpressionArena arena;
+    ExpressionArena::Scope scope(arena);
     SET_NORMALIZATION_ASSERT("[a-g][h-n]", rC('a', 'g') + rC('h', 'n'));
     SET_NORMALIZATION_ASSERT("[a-gg-n]", rC('a', 'n'));
     SET_NORMALIZATION_ASSERT("[0-21-32-4]", rC('0', '4'));
@@ -45,13 +58,134 @@ TEST(RegexAlgorithm, SetNormalization) {
 }
 
 TEST(RegexAlgorithm, SetUnification) {
+    ExpressionArena arena;
+    ExpressionArena::Scope scope(arena);
     SET_UNIFICATION_ASSERT("[a-g][h-n]", rC('a', 'g') + rC('h', 'n'));
     SET_UNIFICATION_ASSERT("[a-gg-n]", rC('a', 'n'));
     SET_UNIFICATION_ASSERT("[0-21-32-4]", rC('0', '4'));
     SET_UNIFICATION_ASSERT("[^C-X][A-Z]", (rC('\x01', '@') <<= rC('A', 'B') <<= rC('Y', 'Z') <<= rC('[', '\xFF')) + (rC('A', 'B') <<= rC('C', 'X') <<= rC('Y', 'Z')));
     SET_UNIFICATION_ASSERT("[0-21-32-46-76-9]", rC('0', '4') <<= rC('6', '9'));
-    SET_UNIFICATION_ASSERT("[a-b]|(ax)", (rC('a', 'a')<<=rC('b', 'b')) | (rR('a', 'a') + rR('x', 'x')));
-    SET_UNIFICATION_ASSERT("(ax)|[a-b]", (rR('a', 'a') + rR('x', 'x')) | (rC('a', 'a')<<=rC('b', 'b')));
+    SET_UNIFICATION_ASSERT("[a-b]|(ax)", (rC('a', 'a')<<=rC('b', 'b')) | (rR('a', 'a') + rR('x', 'x')).group(1));
+    SET_UNIFICATION_ASSERT("(ax)|[a-b]", (rR('a', 'a') + rR('x', 'x')).group(1) | (rC('a', 'a')<<=rC('b', 'b')));
+}
+
+TEST(RegexAlgorithm, Factorization) {
+    ExpressionArena arena;
+    ExpressionArena::Scope scope(arena);
+    FACTORIZATION_ASSERT("abc|abd", rR('a') + (rR('b') + (rR('c') | rR('d'))));
+    FACTORIZATION_ASSERT("ac|bc", (rR('a') | rR('b')) + rR('c'));
+    FACTORIZATION_ASSERT("a|ab", rR('a') + rR('b').zeroOrOne(false));
+    FACTORIZATION_ASSERT("ab|a", rR('a') + rR('b').zeroOrOne());
+    FACTORIZATION_ASSERT("ab|c|ad", (rR('a') + (rR('b') | rR('d'))) | rR('c'));
+    FACTORIZATION_ASSERT("ab|[a-c]|ad", (rR('a') + rR('b')) | (rC('a', 'c') | (rR('a') + rR('d'))));
+    FACTORIZATION_ASSERT("x(ab|ac)*", rR('x') + (rR('a') + (rR('b') | rR('c'))).group(1).zeroOrMore());
+    // heads that can match in more than one way stay put
+    FACTORIZATION_ASSERT("a??b|a??c", (rR('a').zeroOrOne(false) + rR('b')) | (rR('a').zeroOrOne(false) + rR('c')));
+    FACTORIZATION_ASSERT("(a|ab)c|(a|ab)d", ((rR('a') + rR('b').zeroOrOne(false)).group(1) + rR('c')) | ((rR('a') + rR('b').zeroOrOne(false)).group(2) + rR('d')));
+    FACTORIZATION_ASSERT("[a-c]x|[a-c]y", rC('a', 'c') + (rR('x') | rR('y')));
+}
+
+TEST(RegexAlgorithm, FactorizationNfaSize) {
+    ExpressionArena arena;
+    ExpressionArena::Scope scope(arena);
+    const char *keywords = "auto|break|case|char|const|continue|default|do|double|else|enum|extern|float|for|goto|if|int|long|register|return|short|signed|sizeof|static|struct|switch|typedef|union|unsigned|void|volatile|while";
+    auto plain = parseRegex(keywords)->generateEpsilonNfa();
+    auto factorized = factorize(parseRegex(keywords))->generateEpsilonNfa();
+    EXPECT_LT(factorized->states.size(), plain->states.size());
+}
+
+TEST(RegexAlgorithm, Simplification) {
+    ExpressionArena arena;
+    ExpressionArena::Scope scope(arena);
+    SIMPLIFICATION_ASSERT("(a*)*", rR('a').zeroOrMore());
+    SIMPLIFICATION_ASSERT("(x?)?", rR('x').zeroOrOne());
+    SIMPLIFICATION_ASSERT("((a+)?)+", rR('a').zeroOrMore());
+    SIMPLIFICATION_ASSERT("(a*?)*", rR('a').zeroOrMore(false).zeroOrMore());
+    SIMPLIFICATION_ASSERT("ab|cd|ab", (rR('a') + rR('b')) | (rR('c') + rR('d')));
+    SIMPLIFICATION_ASSERT("a|b|a", rR('a', 'b'));
+    SIMPLIFICATION_ASSERT("[a-c]|[b-d]", rR('a', 'd'));
+    SIMPLIFICATION_ASSERT("x[]y{1}", rR('x') + rR('y'));
+    EXPECT_TRUE(simplify(parseRegex("(ab)*"), true)->equals((rR('a') + rR('b')).group(1).zeroOrMore().expression));
+}
+
+TEST(RegexAlgorithm, SimplificationStatistics) {
+    ExpressionArena arena;
+    ExpressionArena::Scope scope(arena);
+    const char *pattern = "(a*)*|(a*)*|b{1}|[]c|(xy)?";
+    SimplificationStatistics statistics;
+    auto simplified = simplify(parseRegex(pattern), false, &statistics);
+    EXPECT_EQ(statistics.rewrites[SimplificationStatistics::NestedRepeat], 2);
+    EXPECT_EQ(statistics.rewrites[SimplificationStatistics::DuplicateAlternative], 1);
+    EXPECT_EQ(statistics.rewrites[SimplificationStatistics::UnitRepeat], 1);
+    EXPECT_EQ(statistics.rewrites[SimplificationStatistics::EmptySet], 1);
+    EXPECT_EQ(statistics.rewrites[SimplificationStatistics::MergeRanges], 1);
+    EXPECT_EQ(statistics.rewrites[SimplificationStatistics::Ungroup], 3);
+    int64_t saved = 0;
+    for (auto states : statistics.statesSaved)
+        saved += states;
+    auto plain = parseRegex(pattern)->generateEpsilonNfa();
+    EXPECT_EQ(saved, static_cast<int64_t>(plain->states.size() - simplified->generateEpsilonNfa()->states.size()));
+    EXPECT_GT(statistics.statesSaved[SimplificationStatistics::DuplicateAlternative], 0);
+}
+
+TEST(RegexAlgorithm, Interning) {
+    ExpressionArena arena;
+    ExpressionArena::Scope scope(arena);
+    InterningVisitor interner;
+    auto interned = interner.intern(parseRegex("ab|ab"));
+    EXPECT_EQ(interner.size(), 4);
+    auto select = expressionCast<SelectExpression>(interned);
+    ASSERT_TRUE(select);
+    EXPECT_EQ(select->items[0], select->items[1]);
+    EXPECT_EQ(interner.intern(parseRegex("ab|ab")), interned);
+    EXPECT_EQ(interner.size(), 4);
+    EXPECT_EQ(interner.hash(interned), StructuralHashVisitor().invoke(parseRegex("ab|ab"), nullptr));
+    EXPECT_EQ(interned->generateEpsilonNfa()->states.size(), parseRegex("ab|ab")->generateEpsilonNfa()->states.size());
+
+    StructuralHashVisitor hash;
+    EXPECT_NE(hash.invoke(parseRegex("ab"), nullptr), hash.invoke(parseRegex("ba"), nullptr));
+    EXPECT_NE(hash.invoke(parseRegex("a*"), nullptr), hash.invoke(parseRegex("a*?"), nullptr));
+    EXPECT_NE(hash.invoke(parseRegex("(a)(b)"), nullptr), hash.invoke(parseRegex("(a)b"), nullptr));
+    auto grouped = interner.intern(parseRegex("(a)|(a)"));
+    select = expressionCast<SelectExpression>(grouped);
+    EXPECT_NE(select->items[0], select->items[1]);
+}
+
+TEST(RegexAlgorithm, DeeplyNested) {
+    ExpressionArena arena;
+    ExpressionArena::Scope scope(arena);
+    std::string nested = std::string(50000, '(') + "a|a" + std::string(50000, ')');
+    EXPECT_TRUE(simplify(parseRegex(nested))->equals(rR('a').expression));
+    EXPECT_TRUE(simplify(parseRegex(nested), true)->equals(parseRegex(std::string(50000, '(') + "a" + std::string(50000, ')'))));
+    InterningVisitor interner;
+    interner.intern(parseRegex(nested));
+    EXPECT_EQ(interner.size(), 50002);
+    auto factorized = factorize(parseRegex(nested));
+    EXPECT_EQ(NfaSizeVisitor().invoke(factorized, nullptr), 2);
+    EXPECT_NE(StructuralHashVisitor().invoke(factorized, nullptr), StructuralHashVisitor().invoke(parseRegex(nested), nullptr));
+}
+
+TEST(RegexAlgorithm, KindDispatch) {
+    ExpressionArena arena;
+    ExpressionArena::Scope scope(arena);
+    auto expression = parseRegex("(a|^)*[b-c]$");
+    EXPECT_EQ(expression->kind, Expression::Concatenation);
+    auto concatenation = expressionCast<ConcatenationExpression>(expression);
+    ASSERT_TRUE(concatenation);
+    EXPECT_EQ(concatenation->items[0]->kind, Expression::Repeat);
+    EXPECT_EQ(concatenation->items[1]->kind, Expression::Set);
+    EXPECT_EQ(concatenation->items[2]->kind, Expression::End);
+    EXPECT_FALSE(expressionCast<SelectExpression>(expression));
+    EXPECT_FALSE(expressionCast<SelectExpression>(nullptr));
+
+    // a visit may invoke the visitor again, result and all
+    NfaSizeVisitor size;
+    int64_t states = size.invoke(expression, nullptr);
+    EXPECT_EQ(size.invoke(concatenation->items[0], nullptr) + size.invoke(concatenation->items[1], nullptr) + 2, states);
+    Range<unsigned char>::List unifiedRanges;
+    expression->setNormalize(&unifiedRanges);
+    expression->setUnify(unifiedRanges);
+    EXPECT_EQ(static_cast<int64_t>(expression->generateEpsilonNfa()->states.size()), states);
 }
 
 // Step 3. Call RUN_ALL_TESTS() in main().
@@ -0,0 +1,76 @@
+// Step 1. Include necessary header files such that the stuff your
+// test logic needs is declared.
+//
+// Don't forget gtest.h, which declares the testing framework.
+
+#include <cstring>
+#include <string>
+#include "regex_compiler.h"
+#include "identifier.h"
+#include "floatingConstant.h"
+#include "gtest/gtest.h"
+
+using std::string;
+
+// Step 2. Use the TEST macro to define your tests.
+//
+// TEST has two parameters: the test case name and the test name.
+// After using the macro, you should define your test logic between a
+// pair of braces.  You can use a bunch of macros to indicate the
+// success or failure of a test.  EXPECT_TRUE and EXPECT_EQ are
+// examples of such macros.  For a complete list, see gtest.h.
+
+// generated matchers must agree with PoorInterpreter on the same pattern
+#define GENERATED_ASSERT(name, pattern, input) do { \
+    auto interpreter = compile(pattern); \
+    const char *text = input; \
+    size_t length = strlen(text); \
+    PoorInterpreter::Result expect; \
+    bool found = interpreter->search(text, &expect); \
+    size_t start, matchLength; \
+    EXPECT_EQ(name##Search(text, length, &start, &matchLength), found) << text; \
+    if (found) { \
+        EXPECT_EQ(start, size_t(expect.start)) << text; \
+        EXPECT_EQ(matchLength, size_t(expect.length)) << text; \
+    } \
+    EXPECT_EQ(name##Match(text, length), interpreter->match(text)) << text; \
+} while (0)
+
+string identifier = "[a-zA-Z_$][0-9a-zA-Z_$]*";
+string floatingConstant = "((((([0-9]*\\.[0-9]+)|([0-9]+\\.))([eE][-+]?[0-9]+)?)|([0-9]+([eE][-+]?[0-9]+)))[FfLl]?)";
+
+TEST(Codegen, Identifier) {
+    GENERATED_ASSERT(identifier, identifier, "identifier");
+    GENERATED_ASSERT(identifier, identifier, "_$0");
+    GENERATED_ASSERT(identifier, identifier, "0abc");
+    GENERATED_ASSERT(identifier, identifier, "  x1 = y2");
+    GENERATED_ASSERT(identifier, identifier, "+-*/");
+    GENERATED_ASSERT(identifier, identifier, "");
+}
+
+TEST(Codegen, FloatingConstant) {
+    GENERATED_ASSERT(floatingConstant, floatingConstant, "1.5e10");
+    GENERATED_ASSERT(floatingConstant, floatingConstant, "x = .5f;");
+    GENERATED_ASSERT(floatingConstant, floatingConstant, "12.");
+    GENERATED_ASSERT(floatingConstant, floatingConstant, "3e+7L");
+    GENERATED_ASSERT(floatingConstant, floatingConstant, "12");
+    GENERATED_ASSERT(floatingConstant, floatingConstant, "e10");
+}
+
+TEST(Codegen, EmbeddedNul) {
+    const char text[] = "ab\0cd";
+    EXPECT_EQ(identifierHead(text, sizeof(text) - 1), 2);
+    EXPECT_EQ(identifierHead(text + 3, 2), 2);
+}
+
+// Step 3. Call RUN_ALL_TESTS() in main().
+//
+// We do this by linking in src/gtest_main.cc file, which consists of
+// a main() function which calls RUN_ALL_TESTS() for us.
+//
+// This runs all the tests you've defined, prints the result, and
+// returns 0 if successful, or 1 otherwise.
+//
+// Did you notice that we didn't register the tests?  The
+// RUN_ALL_TESTS() macro magically knows about all the tests we
+// defined.  Isn't this convenient?
@@ -0,0 +1,412 @@
+// Step 1. Include necessary header files such that the stuff your
+// test logic needs is declared.
+//
+// Don't forget gtest.h, which declares the testing framework.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "regex_compiler.h"
+#include "regex_exception.h"
+#include "gtest/gtest.h"
+
+using std::string;
+
+// Step 2. Use the TEST macro to define your tests.
+//
+// TEST has two parameters: the test case name and the test name.
+// After using the macro, you should define your test logic between a
+// pair of braces.  You can use a bunch of macros to indicate the
+// success or failure of a test.  EXPECT_TRUE and EXPECT_EQ are
+// examples of such macros.  For a complete list, see gtest.h.
+
+string identifier = "[a-zA-Z_$][0-9a-zA-Z_$]*";
+
+bool exists(const string &path) {
+    return access(path.c_str(), F_OK) == 0;
+}
+
+TEST(Compiler, Key) {
+    CompileOptions options, unfactorized;
+    unfactorized.factorize = false;
+    EXPECT_EQ(compileKey(identifier, options), compileKey(identifier, options));
+    EXPECT_NE(compileKey(identifier, options), compileKey(identifier + "?", options));
+    EXPECT_NE(compileKey(identifier, options), compileKey(identifier, unfactorized));
+    options.cacheDirectory = "elsewhere";
+    EXPECT_EQ(compileKey(identifier, options), compileKey(identifier, CompileOptions()));
+}
+
+TEST(Compiler, Cache) {
+    CompileOptions options;
+    options.cacheDirectory = "compile_cache";
+    mkdir(options.cacheDirectory.c_str(), 0755);
+    string path = cachePath(identifier, options);
+    remove(path.c_str());
+
+    auto compiled = compile(identifier, options);
+    EXPECT_TRUE(exists(path));
+    auto cached = compile(identifier, options);
+    const char *inputs[] = {"_id", "  value1 ", "0x", "$"};
+    for (auto input : inputs) {
+        PoorInterpreter::Result expect, result;
+        bool found = compiled->search(input, &expect);
+        EXPECT_EQ(cached->search(input, &result), found);
+        if (found) {
+            EXPECT_EQ(result.start, expect.start);
+            EXPECT_EQ(result.length, expect.length);
+        }
+    }
+
+    // a damaged entry is rebuilt and replaced
+    {
+        std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+        ofs << "garbage";
+    }
+    EXPECT_TRUE(compile(identifier, options)->match("rebuilt"));
+    EXPECT_TRUE(PoorInterpreter::load(path)->match("rebuilt"));
+
+    // so is a sound entry built from something else, as a hash collision would leave
+    auto copy = [&path](const string &from) {
+        std::ifstream ifs(from, std::ios::binary);
+        std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+        ofs << ifs.rdbuf();
+    };
+    CompileOptions unfactorized = options;
+    unfactorized.factorize = false;
+    compile("[0-9]+", options);
+    compile(identifier, unfactorized);
+    string label = PoorInterpreter::load(path)->getLabel();
+    string others[] = {cachePath("[0-9]+", options), cachePath(identifier, unfactorized)};
+    for (auto &other : others) {
+        copy(other);
+        EXPECT_NE(PoorInterpreter::load(path)->getLabel(), label);
+        auto recompiled = compile(identifier, options);
+        EXPECT_TRUE(recompiled->match("recompiled"));
+        EXPECT_FALSE(recompiled->match("42"));
+        EXPECT_EQ(PoorInterpreter::load(path)->getLabel(), label);
+        remove(other.c_str());
+    }
+
+    remove(path.c_str());
+    rmdir(options.cacheDirectory.c_str());
+}
+
+TEST(Compiler, DeeplyNested) {
+    string nested = string(50000, '(') + "a" + string(50000, ')');
+    string alternatives = string(50000, '(') + "ab|ac" + string(50000, ')') + "*";
+    EXPECT_TRUE(compile(nested)->match("a"));
+    auto interpreter = compile(alternatives);
+    EXPECT_TRUE(interpreter->match("abacab"));
+    EXPECT_FALSE(interpreter->match("abad"));
+    CompileOptions unfactorized;
+    unfactorized.factorize = false;
+    EXPECT_EQ(compile(alternatives, unfactorized)->getStateCount(), interpreter->getStateCount());
+}
+
+TEST(Compiler, NoCacheDirectory) {
+    auto interpreter = compile(identifier);
+    EXPECT_TRUE(interpreter->match("identifier"));
+    EXPECT_FALSE(interpreter->match("0identifier"));
+}
+
+TEST(CompileCache, LeastRecentlyUsed) {
+    size_t bytes = compile("a")->memorySize() + 4;
+    CompileCache cache(2 * bytes);
+    auto a = cache.get("a");
+    auto b = cache.get("b");
+    EXPECT_EQ(cache.get("a"), a);
+    auto c = cache.get("c");
+    auto statistics = cache.getStatistics();
+    EXPECT_EQ(statistics.hits, 1u);
+    EXPECT_EQ(statistics.misses, 3u);
+    EXPECT_EQ(statistics.evictions, 1u);
+    EXPECT_EQ(statistics.entries, 2u);
+    EXPECT_EQ(statistics.bytes, 2 * bytes);
+    EXPECT_EQ(cache.get("a"), a);
+    EXPECT_NE(cache.get("b"), b);
+    EXPECT_TRUE(b->match("b"));
+    EXPECT_EQ(cache.getStatistics().evictions, 2u);
+}
+
+TEST(CompileCache, Options) {
+    CompileCache cache(1 << 20);
+    CompileOptions unfactorized;
+    unfactorized.factorize = false;
+    auto factorized = cache.get("ab|ac");
+    EXPECT_NE(cache.get("ab|ac", unfactorized), factorized);
+    EXPECT_EQ(cache.get("ab|ac"), factorized);
+    cache.clear();
+    EXPECT_EQ(cache.getStatistics().entries, 0u);
+    EXPECT_NE(cache.get("ab|ac"), factorized);
+}
+
+TEST(CompileCache, Oversized) {
+    CompileCache cache(16);
+    auto interpreter = cache.get(identifier);
+    EXPECT_TRUE(interpreter->match("oversized"));
+    EXPECT_EQ(cache.getStatistics().entries, 0u);
+    EXPECT_EQ(cache.getStatistics().evictions, 0u);
+}
+
+TEST(BidirectionalSearcher, SameAsForward) {
+    string floatingConstant = "((((([0-9]*\\.[0-9]+)|([0-9]+\\.))([eE][-+]?[0-9]+)?)|([0-9]+([eE][-+]?[0-9]+)))[FfLl]?)";
+    const char *inputs[] = {"x = 1.5e10;", "a .5f b 3.", "no digits", "", "e1 12 1e+", "ab12cd"};
+    for (auto &pattern : {identifier, floatingConstant, string("(ab|b)*c"), string("x*"), string("^[a-z]+"), string("d$|^a")}) {
+        auto interpreter = compile(pattern);
+        BidirectionalSearcher searcher(pattern);
+        EXPECT_FALSE(searcher.isAnchoredAtEnd());
+        for (auto input : inputs) {
+            PoorInterpreter::Result expect, result;
+            bool found = interpreter->search(input, &expect);
+            EXPECT_EQ(searcher.search(input, strlen(input), &result), found) << pattern << " in " << input;
+            if (found) {
+                EXPECT_EQ(result.start, expect.start) << pattern << " in " << input;
+                EXPECT_EQ(result.length, expect.length) << pattern << " in " << input;
+            }
+        }
+    }
+}
+
+TEST(BidirectionalSearcher, AnchoredAtEnd) {
+    BidirectionalSearcher searcher("took [0-9]+ ms$");
+    EXPECT_TRUE(searcher.isAnchoredAtEnd());
+    PoorInterpreter::Result result;
+    string line = "GET /index took 12 ms, retry took 345 ms";
+    EXPECT_TRUE(searcher.search(line.c_str(), line.size(), &result));
+    EXPECT_EQ(result.start, 29);
+    EXPECT_EQ(result.length, 11);
+    line += " ok";
+    EXPECT_FALSE(searcher.search(line.c_str(), line.size(), &result));
+    EXPECT_TRUE(searcher.searchEndingAt(line.c_str(), line.size() - 3, &result));
+    EXPECT_EQ(result.start, 29);
+
+    BidirectionalSearcher longest("a*$");
+    EXPECT_TRUE(longest.search("baaa", 4, &result));
+    EXPECT_EQ(result.start, 1);
+    EXPECT_EQ(result.length, 3);
+    EXPECT_TRUE(longest.search("aab", 3, &result));
+    EXPECT_EQ(result.start, 3);
+    EXPECT_EQ(result.length, 0);
+
+    BidirectionalSearcher whole("^[0-9]+$");
+    EXPECT_TRUE(whole.isAnchoredAtEnd());
+    EXPECT_TRUE(whole.search("123", 3, &result));
+    EXPECT_EQ(result.start, 0);
+    EXPECT_EQ(result.length, 3);
+    EXPECT_FALSE(whole.search("a123", 4, &result));
+    EXPECT_TRUE(whole.searchEndingAt("12a", 2, &result));
+    EXPECT_EQ(result.length, 2);
+}
+
+TEST(Compiler, Minimization) {
+    string floatingConstant = "((((([0-9]*\\.[0-9]+)|([0-9]+\\.))([eE][-+]?[0-9]+)?)|([0-9]+([eE][-+]?[0-9]+)))[FfLl]?)";
+    string blowup = "(a|b)*a(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)";
+    const char *inputs[] = {"1.5e10", "x = .5f;", "abbbbbbab", "ab_12", "", "babababab"};
+    CompileOptions hopcroft, brzozowski, automatic;
+    hopcroft.minimization = Minimization::Hopcroft;
+    brzozowski.minimization = Minimization::Brzozowski;
+    EXPECT_NE(compileKey(identifier, hopcroft), compileKey(identifier, brzozowski));
+    for (auto &pattern : {identifier, floatingConstant, blowup, string("(a|b)*|" + blowup), string("a*?b|ab"), string("^a(a|b)*b$")}) {
+        auto expect = compile(pattern, hopcroft);
+        for (auto &options : {brzozowski, automatic}) {
+            auto interpreter = compile(pattern, options);
+            EXPECT_EQ(interpreter->getStateCount(), expect->getStateCount()) << pattern;
+            for (auto input : inputs) {
+                PoorInterpreter::Result expectResult, result;
+                bool found = expect->search(input, &expectResult);
+                EXPECT_EQ(interpreter->search(input, &result), found) << pattern << " in " << input;
+                EXPECT_EQ(result.start, expectResult.start) << pattern << " in " << input;
+                EXPECT_EQ(result.length, expectResult.length) << pattern << " in " << input;
+            }
+        }
+    }
+    EXPECT_EQ(compile("(a|b)*|" + blowup)->getStateCount(), 1);
+}
+
+TEST(Compiler, LeftmostFirst) {
+    CompileOptions options;
+    options.semantics = Semantics::LeftmostFirst;
+    EXPECT_NE(compileKey("a|ab", options), compileKey("a|ab", CompileOptions()));
+    PoorInterpreter::Result result;
+    EXPECT_TRUE(compile("a|ab", options)->search("xab", &result));
+    EXPECT_EQ(result.start, 1);
+    EXPECT_EQ(result.length, 1);
+    EXPECT_TRUE(compile("a|ab")->search("xab", &result));
+    EXPECT_EQ(result.length, 2);
+    CompileCache cache(1 << 20);
+    EXPECT_NE(cache.get("a|ab", options), cache.get("a|ab"));
+    // factoring a head out must not let its later ways go before the other alternatives
+    EXPECT_TRUE(compile("a??ab|a??a", options)->searchHead("aab", &result));
+    EXPECT_EQ(result.length, 3);
+    EXPECT_TRUE(compile("^c?|c{0,1}?c(.(c.?[ab]{0,2}).){1,2}|c{0,1}?c?|b$", options)->searchHead("bccdcd", &result, 1));
+    EXPECT_EQ(result.length, 5);
+    EXPECT_TRUE(compile("[^a]|(a{0,1}?)c.|a??", options)->search("aacbb", &result));
+    EXPECT_EQ(result.start, 0);
+    EXPECT_EQ(result.length, 0);
+    EXPECT_TRUE(compile("[^a]|(a{0,1}?)c.|a??", options)->searchHead("aacbb", &result, 1));
+    EXPECT_EQ(result.length, 3);
+    BidirectionalSearcher searcher("<.*?>", options);
+    EXPECT_TRUE(searcher.search("a <b> <c>", 9, &result));
+    EXPECT_EQ(result.start, 2);
+    EXPECT_EQ(result.length, 3);
+}
+
+TEST(Compiler, LeftmostFirstFactorization) {
+    CompileOptions factorized, plain;
+    factorized.semantics = plain.semantics = Semantics::LeftmostFirst;
+    plain.factorize = false;
+    EXPECT_TRUE(CompileOptions().factorize);
+    const char *patterns[] = {
+        "a??ab|a??a", "a*?b|a*?bc|a", "(a|ab)(c|bcd)|abc", "[ab]?b|[ab]?bb|b", "x?y|x??yz|xy",
+        "^c?|c{0,1}?c(.(c.?[ab]{0,2}).){1,2}|c{0,1}?c?|b$", "[^a]|(a{0,1}?)c.|a??",
+        "if|int|in|i", "abc|abd|ab|a",
+    };
+    const char *inputs[] = {"aab", "aaabc", "abcd", "abbb", "xyz", "bccdcd", "aacbb", "int", "abd", ""};
+    for (auto pattern : patterns) {
+        auto expect = compile(pattern, plain), interpreter = compile(pattern, factorized);
+        for (auto input : inputs) {
+            for (uint32_t offset = 0; offset <= strlen(input); ++offset) {
+                PoorInterpreter::Result expectResult, result;
+                bool found = expect->searchHead(input, &expectResult, offset);
+                EXPECT_EQ(interpreter->searchHead(input, &result, offset), found) << pattern << " in " << input << " at " << offset;
+                if (found) {
+                    EXPECT_EQ(result.length, expectResult.length) << pattern << " in " << input << " at " << offset;
+                }
+            }
+        }
+    }
+}
+
+#define CAPTURE_ASSERT(captures, group, s, l) do { \
+    EXPECT_EQ((captures)[group].start, s); \
+    EXPECT_EQ((captures)[group].length, l); \
+} while (0)
+
+TEST(TaggedInterpreter, Groups) {
+    TaggedInterpreter::Captures captures;
+    TaggedInterpreter sequence("(a+)(b+)");
+    EXPECT_EQ(sequence.getGroupCount(), 2);
+    EXPECT_TRUE(sequence.isOnePass());
+    EXPECT_TRUE(sequence.search("xaabbbc", captures));
+    CAPTURE_ASSERT(captures, 0, 1, 5);
+    CAPTURE_ASSERT(captures, 1, 1, 2);
+    CAPTURE_ASSERT(captures, 2, 3, 3);
+    EXPECT_FALSE(sequence.search("xaac", captures));
+    EXPECT_FALSE(sequence.searchHead("xaabb", captures));
+
+    TaggedInterpreter nested("((a)b)+");
+    EXPECT_TRUE(nested.searchHead("ababa", captures));
+    CAPTURE_ASSERT(captures, 0, 0, 4);
+    CAPTURE_ASSERT(captures, 1, 2, 2);
+    CAPTURE_ASSERT(captures, 2, 2, 1);
+
+    TaggedInterpreter alternatives("(a)|(b)");
+    EXPECT_TRUE(alternatives.search("cb", captures));
+    CAPTURE_ASSERT(captures, 1, -1, -1);
+    CAPTURE_ASSERT(captures, 2, 1, 1);
+
+    TaggedInterpreter repeated("(ab|cd)*x");
+    EXPECT_TRUE(repeated.search("abcdabx", captures));
+    CAPTURE_ASSERT(captures, 1, 4, 2);
+    EXPECT_TRUE(repeated.search("x", captures));
+    CAPTURE_ASSERT(captures, 1, -1, -1);
+
+    TaggedInterpreter empty("a()b");
+    EXPECT_TRUE(empty.search("ab", captures));
+    CAPTURE_ASSERT(captures, 1, 1, 0);
+}
+
+TEST(TaggedInterpreter, LeftmostFirst) {
+    TaggedInterpreter::Captures captures;
+    TaggedInterpreter alternatives("(a|ab)(c|bcd)(d*)");
+    EXPECT_FALSE(alternatives.isOnePass());
+    EXPECT_TRUE(alternatives.search("abcd", captures));
+    CAPTURE_ASSERT(captures, 0, 0, 4);
+    CAPTURE_ASSERT(captures, 1, 0, 1);
+    CAPTURE_ASSERT(captures, 2, 1, 3);
+    CAPTURE_ASSERT(captures, 3, 4, 0);
+
+    TaggedInterpreter greedy("(a*)(a*)");
+    EXPECT_TRUE(greedy.search("aaa", captures));
+    CAPTURE_ASSERT(captures, 1, 0, 3);
+    CAPTURE_ASSERT(captures, 2, 3, 0);
+    TaggedInterpreter lazy("(a*?)(a*)");
+    EXPECT_TRUE(lazy.search("aaa", captures));
+    CAPTURE_ASSERT(captures, 1, 0, 0);
+    CAPTURE_ASSERT(captures, 2, 0, 3);
+
+    TaggedInterpreter tag("<(.*?)>");
+    EXPECT_TRUE(tag.search("a <b> <c>", captures));
+    CAPTURE_ASSERT(captures, 0, 2, 3);
+    CAPTURE_ASSERT(captures, 1, 3, 1);
+    EXPECT_TRUE(tag.search("a <b> <c>", captures, 5));
+    CAPTURE_ASSERT(captures, 1, 7, 1);
+}
+
+TEST(TaggedInterpreter, Anchors) {
+    TaggedInterpreter::Captures captures;
+    TaggedInterpreter begin("^(a)|(b)");
+    EXPECT_TRUE(begin.search("ba", captures));
+    CAPTURE_ASSERT(captures, 1, -1, -1);
+    CAPTURE_ASSERT(captures, 2, 0, 1);
+    EXPECT_TRUE(begin.search("ab", captures));
+    CAPTURE_ASSERT(captures, 1, 0, 1);
+    EXPECT_FALSE(begin.search("ca", captures));
+    // only the begin state has threads; the plain start state has none
+    TaggedInterpreter anchored("^(a)");
+    EXPECT_TRUE(anchored.search("ab", captures));
+    CAPTURE_ASSERT(captures, 0, 0, 1);
+    CAPTURE_ASSERT(captures, 1, 0, 1);
+    EXPECT_FALSE(anchored.search("ba", captures));
+    TaggedInterpreter any("^.");
+    EXPECT_TRUE(any.search("xy", captures));
+    CAPTURE_ASSERT(captures, 0, 0, 1);
+    EXPECT_FALSE(any.search("", captures));
+    EXPECT_THROW(TaggedInterpreter("(a)$"), InterpreterException);
+}
+
+TEST(TaggedInterpreter, SameAsLeftmostFirst) {
+    const std::string escapeSequence = "(\\\\(([a-zA-Z._~!=&\\^\\-\\\\?'\"])|([0-9]+)|(x[0-9a-fA-F]+)))";
+    const std::vector<std::string> patterns = {
+        "\"([^\"\\\\\\n]|" + escapeSequence + ")*\"",
+        "/\\*([^*]|\\*+[^*/])*\\*+/",
+        "([0-9]*\\.[0-9]+)|([0-9]+\\.)",
+        "(x+x+)+y",
+    };
+    const char *text = "s = \"a\\tb\\x41\" /* c ** d */ 3.25 + 4. xxxxy xx";
+    CompileOptions options;
+    options.semantics = Semantics::LeftmostFirst;
+    for (auto &pattern : patterns) {
+        auto dfa = compile(pattern, options);
+        TaggedInterpreter tagged(pattern);
+        PoorInterpreter::Result result;
+        TaggedInterpreter::Captures captures;
+        for (uint32_t offset = 0; dfa->search(text, &result, offset); offset = result.start + std::max(result.length, 1)) {
+            EXPECT_TRUE(tagged.search(text, captures, offset));
+            EXPECT_EQ(captures[0].start, result.start);
+            EXPECT_EQ(captures[0].length, result.length);
+            for (auto &capture : captures) {
+                if (capture.start < 0)
+                    continue;
+                EXPECT_GE(capture.start, result.start);
+                EXPECT_LE(capture.start + capture.length, result.start + result.length);
+            }
+        }
+    }
+}
+
+// Step 3. Call RUN_ALL_TESTS() in main().
+//
+// We do this by linking in src/gtest_main.cc file, which consists of
+// a main() function which calls RUN_ALL_TESTS() for us.
+//
+// This runs all the tests you've defined, prints the result, and
+// returns 0 if successful, or 1 otherwise.
+//
+// Did you notice that we didn't register the tests?  The
+// RUN_ALL_TESTS() macro magically knows about all the tests we
+// defined.  Isn't this convenient?
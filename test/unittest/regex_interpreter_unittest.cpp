@@ -5,9 +5,15 @@
 
 #include <climits>
 #include <iostream>
+#include <cstring>
+#include <fstream>
+#include <sstream>
 #include <string>
+#include <tuple>
+#include <vector>
 #include "regex_expression.h"
 #include "regex_interpreter.h"
+#include "regex_exception.h"
 #include "gtest/gtest.h"
 
 using std::string;
@@ -90,14 +96,17 @@ string hexFloatingConstant = "("+hexPrefix+"("+hexDigits+"|"+hexFractionalConsta
 // success or failure of a test.  EXPECT_TRUE and EXPECT_EQ are
 // examples of such macros.  For a complete list, see gtest.h.
 
-PoorInterpreter::Ptr initPoorInterpreter(string re) {
+PoorInterpreter::Ptr initPoorInterpreter(string re, bool leftmostFirst=false) {
+    ExpressionArena arena;
+    ExpressionArena::Scope scope(arena);
     auto  regex = parseRegex(re);
     Range<unsigned char>::List unifiedRanges;
     regex->setNormalize(&unifiedRanges);
     regex->setUnify(unifiedRanges);
+    regex = factorize(regex);
     auto nfa = regex->generateEpsilonNfa();
     std::map<State::List, State::Ptr> nfaStateMap;
-    auto dfa = powerset(nfa, poorEpsilonChecker, nfaStateMap);
+    auto dfa = powerset(nfa, poorEpsilonChecker, nfaStateMap, 0, poorBeginChecker, leftmostFirst);
     std::map<State::Ptr, State::Ptr> dfaStateMap;
     auto mdfa = Hopcroft(dfa, dfaStateMap);
     //mdfa->toMermaid(std::cout);
@@ -437,11 +446,463 @@ TEST(PoorInterpreter, HexFloatingConstant) {
     POOR_MATCH_ASSERT("0Xbadbeef.213P-123L", true);
 }
 
+std::vector<StreamMatcher::Match> searchEach(PoorInterpreter::Ptr interpreter, const char *input) {
+    std::vector<StreamMatcher::Match> matches;
+    PoorInterpreter::Result result;
+    uint32_t offset = 0;
+    while (interpreter->search(input, &result, offset)) {
+        if (result.length > 0) {
+            StreamMatcher::Match match;
+            match.start = result.start;
+            match.length = result.length;
+            matches.emplace_back(match);
+        }
+        offset = result.start + (result.length > 0 ? result.length : 1);
+    }
+    return matches;
+}
+
+std::vector<StreamMatcher::Match> streamEach(PoorInterpreter::Ptr interpreter, const string &input, size_t chunk) {
+    std::vector<StreamMatcher::Match> matches;
+    StreamMatcher matcher(interpreter, [&matches](const StreamMatcher::Match &match) {
+        matches.emplace_back(match);
+    });
+    for (size_t i = 0; i < input.size(); i += chunk)
+        matcher.feed(input.data() + i, std::min(chunk, input.size() - i));
+    matcher.finish();
+    return matches;
+}
+
+#define STREAM_ASSERT(input) { \
+    auto expect = searchEach(interpreter, input); \
+    EXPECT_FALSE(expect.empty()); \
+    for (size_t chunk = 1; chunk <= strlen(input); ++chunk) { \
+        auto actual = streamEach(interpreter, input, chunk); \
+        ASSERT_EQ(actual.size(), expect.size()); \
+        for (size_t i = 0; i < expect.size(); ++i) { \
+            EXPECT_EQ(actual[i].start, expect[i].start); \
+            EXPECT_EQ(actual[i].length, expect[i].length); \
+        } \
+    } \
+} while (0)
+
+TEST(StreamMatcher, Identifier) {
+    auto interpreter = initPoorInterpreter(identifier);
+    STREAM_ASSERT("int main(int argc, char *argv[]) { return argc; }");
+    STREAM_ASSERT("0x1f _a1 $b2 3c");
+}
+
+TEST(StreamMatcher, FloatingConstant) {
+    auto interpreter = initPoorInterpreter(floatingConstant);
+    STREAM_ASSERT("x = 1.5e+10f; y = .25; z = 3.; w = 1e; v = 12.34.56");
+}
+
+TEST(StreamMatcher, StringLiteral) {
+    auto interpreter = initPoorInterpreter(stringLiteral);
+    STREAM_ASSERT("puts(\"hello\\n\"); puts(\"unterminated); \"a\"\"b\"");
+}
+
+TEST(StreamMatcher, Anchors) {
+    auto interpreter = initPoorInterpreter("^[a-z]+|[0-9]+$");
+    STREAM_ASSERT("abc 12 def 345");
+    STREAM_ASSERT("1 b 22");
+}
+
+TEST(StreamMatcher, LongAttempt) {
+    auto interpreter = initPoorInterpreter("a[a-z]*b");
+    STREAM_ASSERT("aaaxaab aaab ab b a");
+    std::vector<StreamMatcher::Match> matches;
+    StreamMatcher matcher(interpreter, [&matches](const StreamMatcher::Match &match) {
+        matches.emplace_back(match);
+    });
+    const string chunk(4096, 'a');
+    for (int i = 0; i < 256; ++i) {
+        matcher.feed(chunk.data(), chunk.size());
+        EXPECT_EQ(matcher.size(), 1);
+    }
+    matcher.feed("b", 1);
+    matcher.finish();
+    ASSERT_EQ(matches.size(), 1);
+    EXPECT_EQ(matches[0].start, 0);
+    EXPECT_EQ(matches[0].length, 256 * chunk.size() + 1);
+}
+
+#define POOR_SEARCH_ALL_ASSERT(input) { \
+    auto expect = searchEach(interpreter, input); \
+    std::vector<PoorInterpreter::Result> actual; \
+    size_t count = interpreter->searchAll(input, [&actual](const PoorInterpreter::Result &result) { \
+        actual.emplace_back(result); \
+    }); \
+    EXPECT_EQ(count, expect.size()); \
+    ASSERT_EQ(actual.size(), expect.size()); \
+    for (size_t i = 0; i < expect.size(); ++i) { \
+        EXPECT_EQ(actual[i].start, expect[i].start); \
+        EXPECT_EQ(actual[i].length, expect[i].length); \
+    } \
+} while (0)
+
+TEST(PoorInterpreter, SearchAll) {
+    auto interpreter = initPoorInterpreter(identifier);
+    POOR_SEARCH_ALL_ASSERT("int main(int argc, char *argv[]) { return argc; }");
+    POOR_SEARCH_ALL_ASSERT("");
+    interpreter = initPoorInterpreter(decimalConstant);
+    POOR_SEARCH_ALL_ASSERT("1 + 22ull - 0 * 0x10 / 07L");
+    interpreter = initPoorInterpreter("a[a-z]*b|x");
+    POOR_SEARCH_ALL_ASSERT("aaxaab aaab ab b axa");
+}
+
+TEST(PoorInterpreter, SearchAllLongAttempt) {
+    // restarting at every offset would read the whole run once per offset
+    auto interpreter = initPoorInterpreter("a[a-z]*b");
+    string input(1 << 20, 'a');
+    std::vector<PoorInterpreter::Result> matches;
+    auto collect = [&matches](const PoorInterpreter::Result &result) {
+        matches.emplace_back(result);
+    };
+    EXPECT_EQ(interpreter->searchAll(input.c_str(), collect), 0u);
+    input += 'b';
+    interpreter->searchAll(input.c_str(), collect);
+    ASSERT_EQ(matches.size(), 1u);
+    EXPECT_EQ(matches[0].start, 0);
+    EXPECT_EQ(matches[0].length, 1 << 20 | 1);
+}
+
+#define POOR_SEARCH_OVERLAPPING_ASSERT(input) { \
+    std::vector<std::pair<int32_t, int32_t>> expect, actual; \
+    for (int32_t start = 0; input[start]; ++start) { \
+        int32_t state = interpreter->getStartState(start); \
+        for (int32_t end = start; input[end] && state != PoorInterpreter::InvalidState; ) { \
+            state = interpreter->transit(state, input[end++]); \
+            if (state != PoorInterpreter::InvalidState \
+                    && (input[end] ? interpreter->isAccepted(state) : interpreter->isAcceptedAtEnd(state))) \
+                expect.emplace_back(start, end - start); \
+        } \
+    } \
+    size_t count = interpreter->searchOverlapping(input, [&actual](const PoorInterpreter::Result &result) { \
+        actual.emplace_back(result.start, result.length); \
+    }); \
+    EXPECT_EQ(count, expect.size()); \
+    std::sort(actual.begin(), actual.end()); \
+    EXPECT_EQ(actual, expect); \
+} while (0)
+
+TEST(PoorInterpreter, SearchOverlapping) {
+    auto interpreter = initPoorInterpreter(identifier);
+    POOR_SEARCH_OVERLAPPING_ASSERT("int main(int argc)");
+    interpreter = initPoorInterpreter("aa|aaa|ab");
+    POOR_SEARCH_OVERLAPPING_ASSERT("aaaaab");
+    interpreter = initPoorInterpreter(floatingConstant);
+    POOR_SEARCH_OVERLAPPING_ASSERT("1.5e+10f .25 3. 12.34.56");
+    interpreter = initPoorInterpreter("^a+|b+$");
+    POOR_SEARCH_OVERLAPPING_ASSERT("aabaabb");
+}
+
+#define POOR_PARALLEL_SEARCH_ALL_ASSERT(input) { \
+    std::vector<std::tuple<int32_t, int32_t, int32_t, int32_t>> expect; \
+    interpreter->searchAll(input, [&expect](const PoorInterpreter::Result &result) { \
+        expect.emplace_back(result.start, result.length, result.terminateState, result.acceptedState); \
+    }); \
+    for (unsigned threads = 1; threads <= 8; ++threads) { \
+        std::vector<std::tuple<int32_t, int32_t, int32_t, int32_t>> actual; \
+        size_t count = interpreter->parallelSearchAll(input, threads, [&actual](const PoorInterpreter::Result &result) { \
+            actual.emplace_back(result.start, result.length, result.terminateState, result.acceptedState); \
+        }); \
+        EXPECT_EQ(count, expect.size()); \
+        EXPECT_EQ(actual, expect); \
+    } \
+} while (0)
+
+TEST(PoorInterpreter, ParallelSearchAll) {
+    auto interpreter = initPoorInterpreter(identifier);
+    POOR_PARALLEL_SEARCH_ALL_ASSERT("int main(int argc, char *argv[]) { return argc; }");
+    interpreter = initPoorInterpreter("a(ba)*b|bb");
+    string input;
+    unsigned seed = 1;
+    for (int i = 0; i < 997; ++i) {
+        seed = seed * 1103515245 + 12345;
+        input.push_back("aab"[(seed >> 16) % 3]);
+    }
+    POOR_PARALLEL_SEARCH_ALL_ASSERT(input.c_str());
+    interpreter = initPoorInterpreter(stringLiteral);
+    POOR_PARALLEL_SEARCH_ALL_ASSERT("\"a\" \"b\\\"c\" \"\" \"long string literal crossing several chunks\" x");
+    // the serial scan resumes inside speculative matches of the next chunk and has to be replayed
+    interpreter = initPoorInterpreter("abc|bca|cab");
+    POOR_PARALLEL_SEARCH_ALL_ASSERT("abcabcabcabcabcabcabcabcabcabcabcabcabcabcabcabcabcabcabcab");
+    interpreter = initPoorInterpreter("x[ab]*y|ab|ba");
+    POOR_PARALLEL_SEARCH_ALL_ASSERT("xabababababababababy abababababababababababababababababab xbababababababababab");
+}
+
+TEST(PoorInterpreter, SearchHeadBatch) {
+    auto interpreter = initPoorInterpreter(floatingConstant);
+    std::vector<const char *> inputs = {
+        "1.5e+10f", ".25", "", "3.", "x", "12.34.56", "1e", "0.0E2", "123.E-012", ".01L", "1.10l", "e1", "1.", "0x1p3",
+        "7.0f and more", ".", "9.9e9L"
+    };
+    for (int prefetch = 0; prefetch < 2; ++prefetch) {
+        std::vector<PoorInterpreter::Result> results(inputs.size());
+        interpreter->searchHeadBatch(inputs.data(), inputs.size(), results.data(), prefetch);
+        for (size_t i = 0; i < inputs.size(); ++i) {
+            PoorInterpreter::Result expect;
+            bool matched = interpreter->searchHead(inputs[i], &expect);
+            EXPECT_EQ(results[i].acceptedState != PoorInterpreter::InvalidState, matched);
+            EXPECT_EQ(results[i].start, expect.start);
+            EXPECT_EQ(results[i].length, expect.length);
+            EXPECT_EQ(results[i].terminateState, expect.terminateState);
+            EXPECT_EQ(results[i].acceptedState, expect.acceptedState);
+        }
+    }
+}
+
+TEST(PoorInterpreter, SearchColumn) {
+    auto interpreter = initPoorInterpreter(hexConstant);
+    std::vector<string> rows = { "x = 0x1f;", "", "0XbadbeefULL", "no hex here", "0x", "mask 0xff and 0x0f", "0x10" };
+    string data;
+    std::vector<int32_t> offsets32(1, 0);
+    for (auto &row : rows) {
+        data += row;
+        offsets32.emplace_back(data.size());
+    }
+    std::vector<int64_t> offsets64(offsets32.begin(), offsets32.end());
+    std::vector<uint8_t> bitmap32(1), bitmap64(1);
+    std::vector<PoorInterpreter::Result> spans(rows.size());
+    EXPECT_EQ(interpreter->searchColumn(data.data(), offsets32.data(), rows.size(), bitmap32.data(), spans.data()), 4u);
+    EXPECT_EQ(interpreter->searchColumn(data.data(), offsets64.data(), rows.size(), bitmap64.data()), 4u);
+    EXPECT_EQ(bitmap32[0], 0x65);
+    EXPECT_EQ(bitmap64[0], 0x65);
+    for (size_t i = 0; i < rows.size(); ++i) {
+        PoorInterpreter::Result expect;
+        if (interpreter->search(rows[i].c_str(), &expect)) {
+            EXPECT_EQ(spans[i].start, expect.start);
+            EXPECT_EQ(spans[i].length, expect.length);
+        } else {
+            EXPECT_EQ(spans[i].start, 0);
+            EXPECT_EQ(spans[i].length, -1);
+            EXPECT_EQ(spans[i].terminateState, PoorInterpreter::InvalidState);
+            EXPECT_EQ(spans[i].acceptedState, PoorInterpreter::InvalidState);
+        }
+    }
+
+    // a long failing attempt in one row must not be rescanned from every offset
+    interpreter = initPoorInterpreter("a[a-z]*b");
+    rows = { string(1 << 20, 'a'), "xaab", string(1 << 16, 'a') + "b" };
+    data.clear();
+    offsets32.assign(1, 0);
+    for (auto &row : rows) {
+        data += row;
+        offsets32.emplace_back(data.size());
+    }
+    spans.assign(rows.size(), PoorInterpreter::Result());
+    EXPECT_EQ(interpreter->searchColumn(data.data(), offsets32.data(), rows.size(), bitmap32.data(), spans.data()), 2u);
+    EXPECT_EQ(bitmap32[0], 0x6);
+    EXPECT_EQ(spans[0].length, -1);
+    EXPECT_EQ(spans[1].start, 1);
+    EXPECT_EQ(spans[1].length, 3);
+    EXPECT_EQ(spans[2].start, 0);
+    EXPECT_EQ(spans[2].length, (1 << 16) + 1);
+}
+
+TEST(PoorInterpreter, SaveLoad) {
+    auto interpreter = initPoorInterpreter(floatingConstant);
+    string path = "poor_interpreter_save_load.dfa";
+    {
+        std::ofstream ofs(path, std::ios::binary);
+        interpreter->save(ofs);
+    }
+    auto loaded = PoorInterpreter::load(path);
+    const char *inputs[] = {"1.5e10", "x = .5f;", "0x1p3", "12", "e10", ""};
+    for (auto input : inputs) {
+        PoorInterpreter::Result expect, result;
+        bool found = interpreter->search(input, &expect);
+        EXPECT_EQ(loaded->search(input, &result), found);
+        if (found) {
+            EXPECT_EQ(result.start, expect.start);
+            EXPECT_EQ(result.length, expect.length);
+        }
+    }
+    remove(path.c_str());
+    interpreter = initPoorInterpreter("^ab|cd$");
+    {
+        std::ofstream ofs(path, std::ios::binary);
+        interpreter->save(ofs);
+    }
+    loaded = PoorInterpreter::load(path);
+    EXPECT_EQ(loaded->getBeginState(), interpreter->getBeginState());
+    const char *anchored[] = {"abcd", "xabcd", "cdx", ""};
+    for (auto input : anchored) {
+        PoorInterpreter::Result expect, result;
+        bool found = interpreter->search(input, &expect);
+        EXPECT_EQ(loaded->search(input, &result), found);
+        if (found) {
+            EXPECT_EQ(result.start, expect.start);
+            EXPECT_EQ(result.length, expect.length);
+        }
+    }
+    remove(path.c_str());
+}
+
+TEST(PoorInterpreter, Anchors) {
+    auto interpreter = initPoorInterpreter("^ab");
+    EXPECT_TRUE(interpreter->isAnchoredAtBegin());
+    POOR_SEARCH_ASSERT("abab", 0, 2);
+    EXPECT_FALSE(interpreter->search("cab"));
+    EXPECT_FALSE(interpreter->search("abab", nullptr, 1));
+    POOR_SEARCH_ALL_ASSERT("ababab");
+    interpreter = initPoorInterpreter("ab$");
+    EXPECT_FALSE(interpreter->isAnchoredAtBegin());
+    POOR_SEARCH_ASSERT("abab", 2, 2);
+    POOR_MATCH_ASSERT("ab", true);
+    EXPECT_FALSE(interpreter->search("abc"));
+    interpreter = initPoorInterpreter("^ab$");
+    POOR_MATCH_ASSERT("ab", true);
+    EXPECT_FALSE(interpreter->search("aab"));
+    EXPECT_FALSE(interpreter->search("abb"));
+    interpreter = initPoorInterpreter("a|^b");
+    EXPECT_FALSE(interpreter->isAnchoredAtBegin());
+    POOR_SEARCH_ASSERT("bca", 0, 1);
+    POOR_SEARCH_ASSERT("cba", 2, 1);
+    interpreter = initPoorInterpreter("x(^y)?");
+    POOR_SEARCH_ASSERT("xy", 0, 1);
+    interpreter = initPoorInterpreter("^$");
+    POOR_SEARCH_ASSERT("", 0, 0);
+    EXPECT_FALSE(interpreter->search("a"));
+    interpreter = initPoorInterpreter("(a$)*");
+    POOR_MATCH_ASSERT("a", true);
+    POOR_SEARCH_ASSERT("aa", 0, 0);
+}
+
+TEST(PoorInterpreter, LeftmostFirst) {
+    auto interpreter = initPoorInterpreter("a+?", true);
+    POOR_SEARCH_ASSERT("baaa", 1, 1);
+    EXPECT_EQ(interpreter->getStateCount(), 2);
+    interpreter = initPoorInterpreter("a|ab", true);
+    POOR_SEARCH_ASSERT("ab", 0, 1);
+    interpreter = initPoorInterpreter("ab|a", true);
+    POOR_SEARCH_ASSERT("ab", 0, 2);
+    interpreter = initPoorInterpreter("a*?b", true);
+    POOR_SEARCH_ASSERT("aab", 0, 3);
+    interpreter = initPoorInterpreter("(a|ab)(c|bcd)", true);
+    POOR_SEARCH_ASSERT("abcd", 0, 4);
+    interpreter = initPoorInterpreter("x*", true);
+    POOR_SEARCH_ASSERT("xx", 0, 2);
+    interpreter = initPoorInterpreter("\"[a-z]*?\"", true);
+    POOR_SEARCH_ASSERT("\"ab\"cd\"", 0, 4);
+    interpreter = initPoorInterpreter("<.*?>", true);
+    POOR_SEARCH_ASSERT("a <b> <c>", 2, 3);
+    interpreter = initPoorInterpreter("<.*>");
+    POOR_SEARCH_ASSERT("a <b> <c>", 2, 7);
+}
+
+// the lazy pattern the rich interpreter was needed for
+TEST(PoorInterpreter, BadStringLiteral) {
+    auto interpreter = initPoorInterpreter(badStringLiteral, true);
+    POOR_MATCH_ASSERT("\"abc\\n\\8abc\"", true);
+    std::vector<PoorInterpreter::Result> matches;
+    size_t count = interpreter->searchAll("s = \"ok\" \"a\\8b\" \"c\\9\"", [&matches](const PoorInterpreter::Result &result) {
+        matches.emplace_back(result);
+    });
+    EXPECT_EQ(count, 2u);
+    ASSERT_EQ(matches.size(), 2u);
+    EXPECT_EQ(matches[0].start, 9);
+    EXPECT_EQ(matches[1].start, 16);
+}
+
+TEST(PoorInterpreter, CountedRepetition) {
+    auto interpreter = initPoorInterpreter("[0-9]{2,4}");
+    POOR_SEARCH_ASSERT("x1 12345", 3, 4);
+    EXPECT_FALSE(interpreter->search("x1 2"));
+    interpreter = initPoorInterpreter("a{3}b{2,}");
+    POOR_SEARCH_ASSERT("aaaabbbc", 1, 6);
+    EXPECT_FALSE(interpreter->search("aabb"));
+    interpreter = initPoorInterpreter("a{2,4}?", true);
+    POOR_SEARCH_ASSERT("aaaa", 0, 2);
+    interpreter = initPoorInterpreter("x{0}y");
+    POOR_SEARCH_ASSERT("xy", 1, 1);
+    interpreter = initPoorInterpreter("[0-9]{1,1000}");
+    EXPECT_EQ(interpreter->getStateCount(), 1001);
+    interpreter = initPoorInterpreter("(a|b){500}");
+    EXPECT_EQ(interpreter->getStateCount(), 501);
+    std::string text(600, 'a');
+    POOR_SEARCH_ASSERT(text.c_str(), 0, 500);
+    interpreter = initPoorInterpreter("a{2}{3}");
+    EXPECT_TRUE(interpreter->match("aaaaaa"));
+    EXPECT_FALSE(interpreter->match("aa{3}"));
+    interpreter = initPoorInterpreter("a*{2}b");
+    EXPECT_TRUE(interpreter->match("aaab"));
+    EXPECT_FALSE(interpreter->match("aaa{2}b"));
+}
+
+// unmatchedQuote = "('"+cconstChar+"*\\n)|('"+cconstChar+"*$)";
+TEST(PoorInterpreter, UnmatchedQuote) {
+    auto interpreter = initPoorInterpreter(unmatchedQuote);
+    POOR_MATCH_ASSERT("'\n", true);
+    POOR_MATCH_ASSERT("'a\n", true);
+    POOR_MATCH_ASSERT("'\\x00\n", true);
+    POOR_MATCH_ASSERT("'", true);
+    POOR_MATCH_ASSERT("'a", true);
+    POOR_MATCH_ASSERT("'\\x00", true);
+    POOR_MATCH_ASSERT("'a'", false);
+    POOR_SEARCH_ASSERT("c = 'a", 4, 2);
+}
+
+TEST(PoorInterpreter, AnchorsBatch) {
+    auto interpreter = initPoorInterpreter("^a+|b+$");
+    const char *inputs[] = {"aab", "bb", "abb", "", "cab"};
+    PoorInterpreter::Result results[5];
+    interpreter->searchHeadBatch(inputs, 5, results);
+    for (size_t i = 0; i < 5; ++i) {
+        PoorInterpreter::Result expect;
+        EXPECT_EQ(results[i].acceptedState != PoorInterpreter::InvalidState, interpreter->searchHead(inputs[i], &expect)) << inputs[i];
+        EXPECT_EQ(results[i].length, expect.length) << inputs[i];
+    }
+    EXPECT_EQ(results[0].length, 2);
+    EXPECT_EQ(results[1].length, 2);
+    EXPECT_EQ(results[2].length, 1);
+    EXPECT_EQ(results[4].length, -1);
+}
+
+TEST(PoorInterpreter, LoadCorrupt) {
+    auto interpreter = initPoorInterpreter(identifier);
+    std::ostringstream oss;
+    interpreter->save(oss);
+    string image = oss.str();
+    string path = "poor_interpreter_corrupt.dfa";
+    auto write = [&path](const string &bytes) {
+        std::ofstream ofs(path, std::ios::binary);
+        ofs.write(bytes.data(), bytes.size());
+    };
+    write(image.substr(0, image.size() - 8));
+    EXPECT_THROW(PoorInterpreter::load(path), InterpreterException);
+    string badMagic = image;
+    badMagic[0] = 'X';
+    write(badMagic);
+    EXPECT_THROW(PoorInterpreter::load(path), InterpreterException);
+    string badTable = image;
+    memset(&badTable[image.size() - 64], 0x7f, 16);
+    write(badTable);
+    EXPECT_THROW(PoorInterpreter::load(path), InterpreterException);
+    write(image);
+    EXPECT_TRUE(PoorInterpreter::load(path)->match("_identifier"));
+    EXPECT_EQ(PoorInterpreter::load(path)->getLabel(), "");
+    std::ostringstream labelled;
+    interpreter->save(labelled, "identifier");
+    write(labelled.str());
+    EXPECT_EQ(PoorInterpreter::load(path)->getLabel(), "identifier");
+    string badLabel = labelled.str();
+    badLabel.resize(badLabel.size() - 8);
+    write(badLabel);
+    EXPECT_THROW(PoorInterpreter::load(path), InterpreterException);
+    remove(path.c_str());
+    EXPECT_THROW(PoorInterpreter::load(path), InterpreterException);
+}
+
 RichInterpreter::Ptr initRichInterpreter(string re) {
+    ExpressionArena arena;
+    ExpressionArena::Scope scope(arena);
     auto  regex = parseRegex(re);
     Range<unsigned char>::List unifiedRanges;
     regex->setNormalize(&unifiedRanges);
     regex->setUnify(unifiedRanges);
+    regex = factorize(regex);
     auto nfa = regex->generateEpsilonNfa();
     std::map<State::List, State::Ptr> nfaStateMap;
     auto dfa = powerset(nfa, richEpsilonChecker, nfaStateMap);
@@ -451,6 +912,49 @@ RichInterpreter::Ptr initRichInterpreter(string re) {
     return RichInterpreter::Ptr(new RichInterpreter(mdfa));
 }
 
+TEST(RichInterpreter, SearchAll) {
+    auto interpreter = initRichInterpreter(identifier);
+    std::vector<RichInterpreter::Result> matches;
+    auto collect = [&matches](const RichInterpreter::Result &result) {
+        matches.emplace_back(result);
+    };
+    EXPECT_EQ(interpreter->searchAll("int main(void) { return 0; }", collect), 4u);
+    ASSERT_EQ(matches.size(), 4u);
+    EXPECT_EQ(matches[1].start, 4);
+    EXPECT_EQ(matches[1].length, 4);
+    EXPECT_EQ(matches[3].start, 17);
+    EXPECT_EQ(matches[3].length, 6);
+    matches.clear();
+    interpreter = initRichInterpreter(badStringLiteral);
+    EXPECT_EQ(interpreter->searchAll("s = \"ok\" \"a\\8b\" \"c\\9\"", collect), 2u);
+    ASSERT_EQ(matches.size(), 2u);
+    EXPECT_EQ(matches[0].start, 9);
+    EXPECT_EQ(matches[1].start, 16);
+
+    interpreter = initRichInterpreter("a[a-z]*b|x");
+    const char *input = "aaxaab aaab ab b axa";
+    std::vector<RichInterpreter::Result> expect;
+    RichInterpreter::Result result;
+    for (uint32_t offset = 0; input[offset]; ) {
+        if (interpreter->searchHead(input, &result, offset) && result.length > 0) {
+            expect.emplace_back(result);
+            offset += result.length;
+        } else
+            ++offset;
+    }
+    matches.clear();
+    EXPECT_EQ(interpreter->searchAll(input, collect), expect.size());
+    ASSERT_EQ(matches.size(), expect.size());
+    for (size_t i = 0; i < expect.size(); ++i) {
+        EXPECT_EQ(matches[i].start, expect[i].start);
+        EXPECT_EQ(matches[i].length, expect[i].length);
+    }
+
+    string run(1 << 16, 'a');
+    matches.clear();
+    EXPECT_EQ(interpreter->searchAll(run.c_str(), collect), 0u);
+}
+
 // identifier = "[a-zA-Z_$][0-9a-zA-Z_$]*";
 TEST(RichInterpreter, Identifier) {
     auto interpreter = initRichInterpreter(identifier);
@@ -0,0 +1,112 @@
+// Step 1. Include necessary header files such that the stuff your
+// test logic needs is declared.
+//
+// Don't forget gtest.h, which declares the testing framework.
+
+#include <string>
+#include <vector>
+#include "regex_compiler.h"
+#include "regex_jit.h"
+#include "gtest/gtest.h"
+
+using std::string;
+
+// Step 2. Use the TEST macro to define your tests.
+//
+// TEST has two parameters: the test case name and the test name.
+// After using the macro, you should define your test logic between a
+// pair of braces.  You can use a bunch of macros to indicate the
+// success or failure of a test.  EXPECT_TRUE and EXPECT_EQ are
+// examples of such macros.  For a complete list, see gtest.h.
+
+string identifier = "[a-zA-Z_$][0-9a-zA-Z_$]*";
+string floatingConstant = "((((([0-9]*\\.[0-9]+)|([0-9]+\\.))([eE][-+]?[0-9]+)?)|([0-9]+([eE][-+]?[0-9]+)))[FfLl]?)";
+string stringLiteral = "\"([^\"\\\\\\n]|(\\\\(([a-zA-Z._~!=&\\^\\-\\\\?'\"])|([0-9]+)|(x[0-9a-fA-F]+))))*\"";
+string comment = "/\\*([^*]|\\*+[^*/])*\\*+/";
+string anything = "a.*z";
+
+// every offset of every input, so that the scan loops start both aligned and not
+void expectSameAsTable(const string &pattern, const std::vector<string> &inputs) {
+    auto table = compile(pattern);
+    JitInterpreter jit(table);
+#if defined(__x86_64__)
+    EXPECT_TRUE(jit.isCompiled());
+#endif
+    for (auto &input : inputs) {
+        for (uint32_t offset = 0; offset <= input.size(); ++offset) {
+            PoorInterpreter::Result expect, result;
+            bool found = table->searchHead(input.c_str(), &expect, offset);
+            EXPECT_EQ(jit.searchHead(input.c_str(), &result, offset), found) << input << " @" << offset;
+            EXPECT_EQ(result.length, expect.length) << input << " @" << offset;
+            EXPECT_EQ(result.terminateState, expect.terminateState) << input << " @" << offset;
+            EXPECT_EQ(result.acceptedState, expect.acceptedState) << input << " @" << offset;
+        }
+        EXPECT_EQ(jit.match(input.c_str()), table->match(input.c_str())) << input;
+    }
+}
+
+TEST(JitInterpreter, Identifier) {
+    expectSameAsTable(identifier, {"identifier", "_$0", "0abc", "  x1 = y2", "", string(100, 'x') + "+y"});
+}
+
+TEST(JitInterpreter, FloatingConstant) {
+    expectSameAsTable(floatingConstant, {"1.5e10", "x = .5f;", "12.", "3e+7L", "12", "e10", "1e", "\xff\x80"});
+}
+
+TEST(JitInterpreter, ScanLoops) {
+    string body(70, 'b');
+    expectSameAsTable(stringLiteral, {"\"" + body + "\"", "\"" + body + "\\n" + body + "\" tail", "\"" + body, "\"\xff\xfe\""});
+    expectSameAsTable(comment, {"/*" + body + "*/", "/*" + body + "**" + body + "*/ x", "/*" + body});
+    expectSameAsTable(anything, {"a" + body + "z" + body, "a" + body + "\nz", "a" + body});
+}
+
+TEST(JitInterpreter, Anchors) {
+    expectSameAsTable("^[a-z]+|[0-9]+$", {"abc 12", "12 abc", "1a2", "", "abc"});
+    expectSameAsTable("d$|^a", {"ad", "bad", "a", "d", "dd"});
+    auto table = compile("^ab");
+    JitInterpreter jit(table);
+    EXPECT_TRUE(jit.search("abab"));
+    EXPECT_FALSE(jit.search("cab"));
+}
+
+TEST(JitInterpreter, Fallback) {
+    auto table = compile(identifier);
+    JitInterpreter jit(table, false);
+    EXPECT_FALSE(jit.isCompiled());
+    PoorInterpreter::Result result;
+    EXPECT_TRUE(jit.search("  abc1 ", &result));
+    EXPECT_EQ(result.start, 2);
+    EXPECT_EQ(result.length, 4);
+    EXPECT_TRUE(jit.match("abc1"));
+}
+
+TEST(JitInterpreter, SearchAll) {
+    auto table = compile(identifier);
+    JitInterpreter jit(table);
+    std::vector<PoorInterpreter::Result> expect, matches;
+    const char *input = "int main(int argc, char *argv[]) { return 0; }";
+    table->searchAll(input, [&expect](const PoorInterpreter::Result &result) {
+        expect.push_back(result);
+    });
+    size_t count = jit.searchAll(input, [&matches](const PoorInterpreter::Result &result) {
+        matches.push_back(result);
+    });
+    EXPECT_EQ(count, expect.size());
+    ASSERT_EQ(matches.size(), expect.size());
+    for (size_t i = 0; i < matches.size(); ++i) {
+        EXPECT_EQ(matches[i].start, expect[i].start);
+        EXPECT_EQ(matches[i].length, expect[i].length);
+    }
+}
+
+// Step 3. Call RUN_ALL_TESTS() in main().
+//
+// We do this by linking in src/gtest_main.cc file, which consists of
+// a main() function which calls RUN_ALL_TESTS() for us.
+//
+// This runs all the tests you've defined, prints the result, and
+// returns 0 if successful, or 1 otherwise.
+//
+// Did you notice that we didn't register the tests?  The
+// RUN_ALL_TESTS() macro magically knows about all the tests we
+// defined.  Isn't this convenient?
@@ -5,6 +5,8 @@
 
 #include <climits>
 #include <iostream>
+#include <stdexcept>
+#include "regex_exception.h"
 #include "regex_expression.h"
 #include "regex_writer.h"
 #include "gtest/gtest.h"
@@ -24,7 +26,7 @@
 } while (0)
 
 #define REGEX_ASSERT3(str, node, parse) { \
-    const char *input = str; EXPECT_TRUE(parse(input)->equals((node).expression.get())); \
+    const char *input = str; EXPECT_TRUE(parse(input)->equals((node).expression)); \
 } while (0)
 
 TEST(RegexParser, Char) {
@@ -39,17 +41,23 @@ TEST(RegexParser, Char) {
 }
 
 TEST(RegexParser, SetItem) {
+    ExpressionArena arena;
+    ExpressionArena::Scope scope(arena);
     REGEX_ASSERT3("a-b", rR('a', 'b'), parseSetItem);
     REGEX_ASSERT3("a", rR('a'), parseSetItem);
     REGEX_ASSERT3("\\-", rR('-'), parseSetItem);
 }
 
 TEST(RegexParser, SetItems) {
+    ExpressionArena arena;
+    ExpressionArena::Scope scope(arena);
     REGEX_ASSERT3("a-b", rR('a', 'b'), parseSetItems);
     REGEX_ASSERT3("a-bx", rR('a', 'b') | rR('x'), parseSetItems);
 }
 
 TEST(RegexParser, ElementaryRE) {
+    ExpressionArena arena;
+    ExpressionArena::Scope scope(arena);
     REGEX_ASSERT3("\\r", rR('\r'), parseElementaryRE);
     REGEX_ASSERT3("\\n", rR('\n'), parseElementaryRE);
     REGEX_ASSERT3("\\t", rR('\t'), parseElementaryRE);
@@ -66,6 +74,8 @@ TEST(RegexParser, ElementaryRE) {
 }
 
 TEST(RegexParser, BasicRE) {
+    ExpressionArena arena;
+    ExpressionArena::Scope scope(arena);
     REGEX_ASSERT3("[0-9]*", rD().zeroOrMore(), parseBasicRE);
     REGEX_ASSERT3("[0-9]+", rD().oneOrMore(), parseBasicRE);
     REGEX_ASSERT3("[0-9]?", rD().zeroOrOne(), parseBasicRE);
@@ -77,14 +87,18 @@ TEST(RegexParser, BasicRE) {
 }
 
 TEST(RegexParser, SimpleRE) {
-    REGEX_ASSERT3("a+(bc)*", rR('a').oneOrMore() + (rR('b') + rR('c')).zeroOrMore(), parseSimpleRE);
-    REGEX_ASSERT3("(1+2)*(3+4)", (rR('1').oneOrMore() + rR('2')).zeroOrMore() + (rR('3').oneOrMore() + rR('4')), parseSimpleRE);
+    ExpressionArena arena;
+    ExpressionArena::Scope scope(arena);
+    REGEX_ASSERT3("a+(bc)*", rR('a').oneOrMore() + (rR('b') + rR('c')).group().zeroOrMore(), parseSimpleRE);
+    REGEX_ASSERT3("(1+2)*(3+4)", (rR('1').oneOrMore() + rR('2')).group().zeroOrMore() + (rR('3').oneOrMore() + rR('4')).group(), parseSimpleRE);
     REGEX_ASSERT3("[A-Za-z_][A-Za-z0-9_]*", rL() + rW().zeroOrMore(), parseSimpleRE);
     REGEX_ASSERT3(".*[\\r\\n\\t]", rAnyChar().zeroOrMore() + (rC('\r') <<= rC('\n') <<= rC('\t')), parseSimpleRE);
     REGEX_ASSERT3("[a-bx]*[1-9]+", ((rC('a', 'b') <<= rC('x')).zeroOrMore() + rC('1', '9').oneOrMore()), parseSimpleRE);
 }
 
 TEST(RegexParser, RE) {
+    ExpressionArena arena;
+    ExpressionArena::Scope scope(arena);
     REGEX_ASSERT3("\\r", rR('\r'), parseRE);
     REGEX_ASSERT3("\\n", rR('\n'), parseRE);
     REGEX_ASSERT3("\\t", rR('\t'), parseRE);
@@ -108,14 +122,91 @@ TEST(RegexParser, RE) {
     REGEX_ASSERT3("[a-bx]*", (rC('a', 'b') <<= rC('x')).zeroOrMore(), parseRE);
     REGEX_ASSERT3("[1-9]+", rC('1', '9').oneOrMore(), parseRE);
 
-    REGEX_ASSERT3("a+(bc)*", rR('a').oneOrMore() + (rR('b') + rR('c')).zeroOrMore(), parseRE);
-    REGEX_ASSERT3("(1+2)*(3+4)", (rR('1').oneOrMore() + rR('2')).zeroOrMore() + (rR('3').oneOrMore() + rR('4')), parseRE);
+    REGEX_ASSERT3("a+(bc)*", rR('a').oneOrMore() + (rR('b') + rR('c')).group().zeroOrMore(), parseRE);
+    REGEX_ASSERT3("(1+2)*(3+4)", (rR('1').oneOrMore() + rR('2')).group().zeroOrMore() + (rR('3').oneOrMore() + rR('4')).group(), parseRE);
     REGEX_ASSERT3("[A-Za-z_][A-Za-z0-9_]*", rL() + rW().zeroOrMore(), parseSimpleRE);
     REGEX_ASSERT3(".*[\\r\\n\\t]", rAnyChar().zeroOrMore() + (rC('\r') <<= rC('\n') <<= rC('\t')), parseRE);
     REGEX_ASSERT3("[a-bx]*[1-9]+", ((rC('a', 'b') <<= rC('x')).zeroOrMore() + rC('1', '9').oneOrMore()), parseRE);
 
     REGEX_ASSERT3("ab|ac", (rR('a') + rR('b')) | (rR('a') + rR('c')), parseRE);
-    REGEX_ASSERT3("a(b|c)", rR('a') + (rR('b') | rR('c')), parseRE);
+    REGEX_ASSERT3("a(b|c)", rR('a') + (rR('b') | rR('c')).group(), parseRE);
+}
+
+TEST(RegexParser, Groups) {
+    ExpressionArena arena;
+    ExpressionArena::Scope scope(arena);
+    auto expression = parseRegex("(a(b))|(c)()");
+    EXPECT_TRUE(expression->equals(((rR('a') + rR('b').group(2)).group(1) | (rR('c').group(3) + RegexNode(nullptr).group(4))).expression));
+    EXPECT_FALSE(expression->equals(((rR('a') + rR('b').group(1)).group(2) | (rR('c').group(3) + RegexNode(nullptr).group(4))).expression));
+    EXPECT_EQ(numberGroups(expression), 4);
+    EXPECT_EQ(numberGroups(parseRegex("a|b*")), 0);
+}
+
+TEST(RegexParser, CountedRepetition) {
+    ExpressionArena arena;
+    ExpressionArena::Scope scope(arena);
+    REGEX_ASSERT3("a{3}", rR('a').repeat(3, 3), parseRE);
+    REGEX_ASSERT3("a{2,}", rR('a').repeat(2, -1), parseRE);
+    REGEX_ASSERT3("a{2,5}?", rR('a').repeat(2, 5, false), parseRE);
+    REGEX_ASSERT3("(ab){0,1000}", (rR('a') + rR('b')).group().repeat(0, 1000), parseRE);
+    REGEX_ASSERT3("a{,5}", rR('a') + (rR('{') + (rR(',') + (rR('5') + rR('}')))), parseRE);
+    REGEX_ASSERT3("a{x}", rR('a') + (rR('{') + (rR('x') + rR('}'))), parseRE);
+    REGEX_ASSERT3("a\\{2\\}", rR('a') + (rR('{') + (rR('2') + rR('}'))), parseRE);
+    EXPECT_THROW(parseRegex("a{1001}"), LexerException);
+    EXPECT_THROW(parseRegex("a{3,2}"), LexerException);
+    REGEX_ASSERT3("a{2}{3}", rR('a').repeat(2, 2).repeat(3, 3), parseRE);
+    REGEX_ASSERT3("a*{2}", rR('a').zeroOrMore().repeat(2, 2), parseRE);
+    REGEX_ASSERT3("a+?*", rR('a').repeat(1, -1, false).zeroOrMore(), parseRE);
+    REGEX_ASSERT3("(ab)?{2,}", (rR('a') + rR('b')).group().zeroOrOne().repeat(2, -1), parseRE);
+}
+
+TEST(RegexParser, Arena) {
+    EXPECT_THROW(parseRegex("a"), std::logic_error);
+    EXPECT_THROW(rR('a'), std::logic_error);
+    ExpressionArena outer;
+    ExpressionArena::Scope scope(outer);
+    auto expression = parseRegex("(ab|c)*d");
+    size_t bytes = outer.bytes();
+    EXPECT_GT(bytes, 0u);
+    {
+        ExpressionArena inner;
+        ExpressionArena::Scope nested(inner);
+        EXPECT_TRUE(parseRegex("(ab|c)*d")->equals(expression));
+        EXPECT_EQ(inner.bytes(), bytes);
+        EXPECT_EQ(&ExpressionArena::current(), &inner);
+    }
+    EXPECT_EQ(&ExpressionArena::current(), &outer);
+    EXPECT_EQ(outer.bytes(), bytes);
+    EXPECT_TRUE(expression->equals((((rR('a') + rR('b')) | rR('c')).group(1).zeroOrMore() + rR('d')).expression));
+}
+
+TEST(RegexParser, LargePattern) {
+    ExpressionArena arena;
+    ExpressionArena::Scope scope(arena);
+    std::string literal, alternatives;
+    for (size_t i = 0; literal.size() < 200000; ++i)
+        literal += "abcdefghij"[i % 10];
+    for (size_t i = 0; alternatives.size() < 200000; ++i)
+        alternatives += std::string(i ? "|" : "") + "[a-" + "abcdefghij"[i % 10] + "]";
+    std::string nested = std::string(100000, '(') + "a" + std::string(100000, ')');
+
+    auto expression = parseRegex(literal);
+    auto concatenation = expressionCast<ConcatenationExpression>(expression);
+    ASSERT_TRUE(concatenation != nullptr);
+    EXPECT_EQ(concatenation->items.size(), literal.size());
+    EXPECT_TRUE(expression->equals(parseRegex(literal)));
+    EXPECT_FALSE(expression->equals(parseRegex(literal + "a")));
+    EXPECT_EQ(expression->generateEpsilonNfa()->states.size(), 2 * literal.size());
+
+    for (auto &pattern : {alternatives, nested}) {
+        Range<unsigned char>::List unifiedRanges;
+        expression = parseRegex(pattern);
+        EXPECT_TRUE(expression->equals(parseRegex(pattern)));
+        expression->setNormalize(&unifiedRanges);
+        expression->setUnify(unifiedRanges);
+        EXPECT_GT(expression->generateEpsilonNfa()->states.size(), 0u);
+    }
+    EXPECT_THROW(parseRegex("(" + nested), LexerException);
 }
 
 // Step 3. Call RUN_ALL_TESTS() in main().
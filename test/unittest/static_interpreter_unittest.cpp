@@ -0,0 +1,73 @@
+// Step 1. Include necessary header files such that the stuff your
+// test logic needs is declared.
+//
+// Don't forget gtest.h, which declares the testing framework.
+
+#include <cstring>
+#include <string>
+#include "regex_compiler.h"
+#include "identifier_tables.h"
+#include "floatingConstant_tables.h"
+#include "gtest/gtest.h"
+
+using std::string;
+
+// Step 2. Use the TEST macro to define your tests.
+//
+// TEST has two parameters: the test case name and the test name.
+// After using the macro, you should define your test logic between a
+// pair of braces.  You can use a bunch of macros to indicate the
+// success or failure of a test.  EXPECT_TRUE and EXPECT_EQ are
+// examples of such macros.  For a complete list, see gtest.h.
+
+// tables are constant expressions, so they can be walked at compile time
+static_assert(!identifierInterpreter.isAccepted(identifierInterpreter.getStartState()), "");
+static_assert(identifierInterpreter.isAccepted(identifierInterpreter.transit(identifierInterpreter.getStartState(), 'a')), "");
+static_assert(identifierInterpreter.transit(identifierInterpreter.getStartState(), '0') == StaticInterpreter::InvalidState, "");
+
+// a static interpreter must agree with PoorInterpreter on the same pattern
+#define STATIC_ASSERT(interpreter, pattern, input) do { \
+    auto compiled = compile(pattern); \
+    const char *text = input; \
+    PoorInterpreter::Result expect, result; \
+    bool found = compiled->search(text, &expect); \
+    EXPECT_EQ(interpreter.search(text, &result), found) << text; \
+    if (found) { \
+        EXPECT_EQ(result.start, expect.start) << text; \
+        EXPECT_EQ(result.length, expect.length) << text; \
+    } \
+    EXPECT_EQ(interpreter.match(text), compiled->match(text)) << text; \
+} while (0)
+
+string identifier = "[a-zA-Z_$][0-9a-zA-Z_$]*";
+string floatingConstant = "((((([0-9]*\\.[0-9]+)|([0-9]+\\.))([eE][-+]?[0-9]+)?)|([0-9]+([eE][-+]?[0-9]+)))[FfLl]?)";
+
+TEST(StaticInterpreter, Identifier) {
+    STATIC_ASSERT(identifierInterpreter, identifier, "identifier");
+    STATIC_ASSERT(identifierInterpreter, identifier, "_$0");
+    STATIC_ASSERT(identifierInterpreter, identifier, "0abc");
+    STATIC_ASSERT(identifierInterpreter, identifier, "  x1 = y2");
+    STATIC_ASSERT(identifierInterpreter, identifier, "+-*/");
+    STATIC_ASSERT(identifierInterpreter, identifier, "");
+}
+
+TEST(StaticInterpreter, FloatingConstant) {
+    STATIC_ASSERT(floatingConstantInterpreter, floatingConstant, "1.5e10");
+    STATIC_ASSERT(floatingConstantInterpreter, floatingConstant, "x = .5f;");
+    STATIC_ASSERT(floatingConstantInterpreter, floatingConstant, "12.");
+    STATIC_ASSERT(floatingConstantInterpreter, floatingConstant, "3e+7L");
+    STATIC_ASSERT(floatingConstantInterpreter, floatingConstant, "12");
+    STATIC_ASSERT(floatingConstantInterpreter, floatingConstant, "e10");
+}
+
+// Step 3. Call RUN_ALL_TESTS() in main().
+//
+// We do this by linking in src/gtest_main.cc file, which consists of
+// a main() function which calls RUN_ALL_TESTS() for us.
+//
+// This runs all the tests you've defined, prints the result, and
+// returns 0 if successful, or 1 otherwise.
+//
+// Did you notice that we didn't register the tests?  The
+// RUN_ALL_TESTS() macro magically knows about all the tests we
+// defined.  Isn't this convenient?